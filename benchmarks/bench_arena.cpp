@@ -0,0 +1,98 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Startup cost of defining a large flag set: time per define() and heap
+// allocations per flag, counted by replacing the global operator new, for
+// a registry on the heap and one with RegistryOptions::arena. Names and
+// descriptions are longer than the small-string buffer, as real ones are.
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+void* counted_alloc(std::size_t size, std::size_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = nullptr;
+  if (alignment <= alignof(std::max_align_t)) {
+    p = std::malloc(size ? size : 1);
+  } else if (posix_memalign(&p, alignment, size ? size : 1) != 0) {
+    p = nullptr;
+  }
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size, 0); }
+void* operator new[](std::size_t size) { return counted_alloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t a) {
+  return counted_alloc(size, static_cast<std::size_t>(a));
+}
+void* operator new[](std::size_t size, std::align_val_t a) {
+  return counted_alloc(size, static_cast<std::size_t>(a));
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  for (std::size_t count : {1000, 10000, 100000}) {
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < count; ++i) {
+      names.push_back("service.feature.rollout_flag_" + std::to_string(i));
+    }
+
+    for (bool arena : {false, true}) {
+      flagpp::RegistryOptions registry_options;
+      registry_options.arena = arena;
+
+      // Repeat whole startups until the duration is used up
+      std::uint64_t defined = 0;
+      std::uint64_t allocated = 0;
+      double seconds = 0.0;
+      do {
+        flagpp::FlagRegistry registry(registry_options);
+        std::uint64_t before = allocations.load(std::memory_order_relaxed);
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto& name : names) {
+          bench::do_not_optimize(
+              registry.define(name, false, "Enables the feature behind this flag"));
+        }
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin)
+                       .count();
+        allocated += allocations.load(std::memory_order_relaxed) - before;
+        defined += count;
+      } while (seconds * 1e3 < static_cast<double>(options.duration.count()));
+
+      char per_flag[32];
+      std::snprintf(per_flag, sizeof(per_flag), "%.2f",
+                    static_cast<double>(allocated) / static_cast<double>(defined));
+      bench::Result result;
+      result.name = "FlagRegistry::define";
+      result.ops = defined;
+      result.ns_per_op = seconds * 1e9 / static_cast<double>(defined);
+      result.mops_per_sec = static_cast<double>(defined) / seconds / 1e6;
+      reporter.add(result, {{"registry", arena ? "arena" : "heap"},
+                            {"flags", std::to_string(count)},
+                            {"allocs/flag", per_flag}});
+    }
+  }
+
+  return 0;
+}
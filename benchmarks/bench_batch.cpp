@@ -0,0 +1,91 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <string>
+#include <vector>
+
+// Evaluating the 20-50 flags a request handler checks: one call per flag
+// against one batch call by name and one by handle. Each op is a batch.
+
+namespace {
+
+const std::size_t kBatchSizes[] = {20, 50};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  std::vector<std::string> owned;
+  for (std::size_t i = 0; i < 50; ++i) {
+    owned.push_back("batch_flag_" + std::to_string(i));
+    flagpp::flags::define(owned.back(), static_cast<int>(i));
+  }
+  // Unrelated flags so the registry is not trivially small
+  for (std::size_t i = 0; i < 1000; ++i) {
+    flagpp::flags::define("batch_filler_" + std::to_string(i), true);
+  }
+
+  for (std::size_t size : kBatchSizes) {
+    std::vector<std::string_view> names(owned.begin(), owned.begin() + size);
+    std::vector<std::shared_ptr<flagpp::Flag>> handles;
+    for (auto name : names) {
+      handles.push_back(flagpp::flags::get(name));
+    }
+    std::vector<std::pair<std::string, std::string>> params = {
+        {"flags_per_batch", std::to_string(size)}, {"op", "batch"}};
+
+    for (unsigned threads : bench::thread_counts(options)) {
+      auto per_call = bench::measure(
+          options, "per-call get_value<int>", threads,
+          [&](unsigned, std::atomic<bool>& stop) {
+            std::uint64_t batches = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+              int sum = 0;
+              for (auto name : names) {
+                sum += flagpp::flags::get_value<int>(name).value_or(0);
+              }
+              bench::do_not_optimize(sum);
+              ++batches;
+            }
+            return batches;
+          });
+      reporter.add(per_call, params);
+
+      auto by_name = bench::measure(
+          options, "flags::evaluate by name", threads,
+          [&](unsigned, std::atomic<bool>& stop) {
+            std::uint64_t batches = 0;
+            std::vector<flagpp::FlagValue> results(names.size());
+            flagpp::EvaluationContext context{"user-42"};
+            while (!stop.load(std::memory_order_relaxed)) {
+              flagpp::flags::evaluate(names.data(), names.size(), context,
+                                      results.data());
+              bench::do_not_optimize(results.data());
+              ++batches;
+            }
+            return batches;
+          });
+      reporter.add(by_name, params);
+
+      auto by_handle = bench::measure(
+          options, "evaluate by handle", threads,
+          [&](unsigned, std::atomic<bool>& stop) {
+            std::uint64_t batches = 0;
+            std::vector<flagpp::FlagValue> results(handles.size());
+            flagpp::EvaluationContext context{"user-42"};
+            while (!stop.load(std::memory_order_relaxed)) {
+              flagpp::evaluate(handles.data(), handles.size(), context,
+                               results.data());
+              bench::do_not_optimize(results.data());
+              ++batches;
+            }
+            return batches;
+          });
+      reporter.add(by_handle, params);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file bench_common.hpp
+ * @brief Minimal multi-threaded benchmark harness for the flagpp benchmarks
+ *
+ * Each measurement runs a loop body on N threads for a fixed duration and
+ * reports ns/op per thread and aggregate throughput. Results are printed
+ * as a table and, with --json <path>, written as a JSON array so runs can
+ * be diffed for regressions.
+ */
+
+#ifndef FLAGPP_BENCH_COMMON_HPP
+#define FLAGPP_BENCH_COMMON_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+/**
+ * @brief Keep a value alive without letting the compiler elide its computation
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+/**
+ * @brief Command-line options shared by all benchmarks
+ */
+struct Options {
+  std::chrono::milliseconds duration{200};
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string json_path;
+};
+
+inline Options parse_options(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) {
+        std::fprintf(stderr, "missing value for %s\n", argv[i]);
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    if (std::strcmp(argv[i], "--duration-ms") == 0) {
+      options.duration = std::chrono::milliseconds(std::atoi(next()));
+    } else if (std::strcmp(argv[i], "--threads") == 0) {
+      options.max_threads = static_cast<unsigned>(std::max(1, std::atoi(next())));
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      options.json_path = next();
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--duration-ms N] [--threads N] [--json PATH]\n",
+                   argv[0]);
+      std::exit(2);
+    }
+  }
+  return options;
+}
+
+/**
+ * @brief Thread counts to sweep: powers of two up to max, plus max itself
+ */
+inline std::vector<unsigned> thread_counts(const Options& options) {
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < options.max_threads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(options.max_threads);
+  return counts;
+}
+
+/**
+ * @brief One measured configuration
+ */
+struct Result {
+  std::string name;
+  std::vector<std::pair<std::string, std::string>> params;
+  unsigned threads = 1;
+  std::uint64_t ops = 0;
+  double ns_per_op = 0.0;
+  double mops_per_sec = 0.0;
+};
+
+/**
+ * @brief Run body(thread_index, stop) on each thread for the configured duration
+ *
+ * The body loops until stop becomes true and returns how many operations it
+ * performed. Threads are released together once all of them have started.
+ *
+ * @return Result ns/op per thread and aggregate throughput
+ */
+template <typename Body>
+Result measure(const Options& options, std::string name, unsigned threads,
+               Body body) {
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> start{false};
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> total{0};
+  std::vector<std::thread> workers;
+
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      ready.fetch_add(1, std::memory_order_relaxed);
+      while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      total.fetch_add(body(t, stop), std::memory_order_relaxed);
+    });
+  }
+
+  while (ready.load(std::memory_order_relaxed) != threads) {
+    std::this_thread::yield();
+  }
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(options.duration);
+  stop.store(true, std::memory_order_relaxed);
+  for (auto& w : workers) {
+    w.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+
+  Result result;
+  result.name = std::move(name);
+  result.threads = threads;
+  result.ops = std::max<std::uint64_t>(total.load(), 1);
+  result.ns_per_op = seconds * 1e9 * threads / static_cast<double>(result.ops);
+  result.mops_per_sec = static_cast<double>(result.ops) / seconds / 1e6;
+  return result;
+}
+
+/**
+ * @brief Collects results, prints them as they arrive and writes JSON at the end
+ */
+class Reporter {
+private:
+  Options options_;
+  std::vector<Result> results_;
+
+  static std::string escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+      }
+      out += c;
+    }
+    return out;
+  }
+
+public:
+  explicit Reporter(Options options) : options_(std::move(options)) {
+    std::printf("%-32s %-28s %7s %12s %12s\n", "benchmark", "params", "threads",
+                "ns/op", "Mops/s");
+  }
+
+  Reporter(const Reporter&) = delete;
+  Reporter& operator=(const Reporter&) = delete;
+
+  ~Reporter() { write_json(); }
+
+  void add(Result result,
+           std::vector<std::pair<std::string, std::string>> params = {}) {
+    result.params = std::move(params);
+    std::string joined;
+    for (const auto& [key, value] : result.params) {
+      joined += (joined.empty() ? "" : ",") + key + "=" + value;
+    }
+    std::printf("%-32s %-28s %7u %12.2f %12.2f\n", result.name.c_str(),
+                joined.c_str(), result.threads, result.ns_per_op,
+                result.mops_per_sec);
+    std::fflush(stdout);
+    results_.push_back(std::move(result));
+  }
+
+  void write_json() const {
+    if (options_.json_path.empty()) {
+      return;
+    }
+    std::FILE* out = std::fopen(options_.json_path.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "cannot open %s\n", options_.json_path.c_str());
+      return;
+    }
+    std::fprintf(out, "[\n");
+    for (std::size_t i = 0; i < results_.size(); ++i) {
+      const Result& r = results_[i];
+      std::fprintf(out, "  {\"name\": \"%s\", \"params\": {",
+                   escape(r.name).c_str());
+      for (std::size_t p = 0; p < r.params.size(); ++p) {
+        std::fprintf(out, "%s\"%s\": \"%s\"", p ? ", " : "",
+                     escape(r.params[p].first).c_str(),
+                     escape(r.params[p].second).c_str());
+      }
+      std::fprintf(out,
+                   "}, \"threads\": %u, \"ops\": %llu, \"ns_per_op\": %.3f, "
+                   "\"mops_per_sec\": %.3f}%s\n",
+                   r.threads, static_cast<unsigned long long>(r.ops),
+                   r.ns_per_op, r.mops_per_sec,
+                   i + 1 < results_.size() ? "," : "");
+    }
+    std::fprintf(out, "]\n");
+    std::fclose(out);
+  }
+};
+
+} // namespace bench
+
+#endif // FLAGPP_BENCH_COMMON_HPP
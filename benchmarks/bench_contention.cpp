@@ -0,0 +1,108 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scalar reads while other threads update the same flags, as in
+// examples/thread_safety.cpp but with no sleeps on either side. Writers
+// run flat out for the whole measurement; only reads are counted. The
+// shared_mutex rows read a FlagValue under std::shared_lock, the
+// lock-per-flag design scalar flags used before, for reference.
+
+namespace {
+
+// A flag value behind a reader-writer lock
+struct LockedValue {
+  mutable std::shared_mutex mutex;
+  flagpp::FlagValue value;
+
+  int read() const {
+    std::shared_lock lock(mutex);
+    const int* i = std::get_if<int>(&value);
+    return i ? *i : 0;
+  }
+
+  void write(int i) {
+    std::unique_lock lock(mutex);
+    value = i;
+  }
+};
+
+// Runs `write(i)` on `writers` threads until the reads finish
+template <typename Read, typename Write>
+bench::Result run(const bench::Options& options, const char* name,
+                  unsigned readers, unsigned writers, Read read, Write write) {
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (unsigned w = 0; w < writers; ++w) {
+    threads.emplace_back([&] {
+      for (int i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+        write(i);
+      }
+    });
+  }
+  bench::Result result =
+      bench::measure(options, name, readers, [&](unsigned, std::atomic<bool>& done) {
+        std::uint64_t ops = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+          for (int k = 0; k < 64; ++k, ++ops) {
+            bench::do_not_optimize(read());
+          }
+        }
+        return ops;
+      });
+  stop.store(true, std::memory_order_relaxed);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  auto dark_mode = flagpp::flags::define("dark_mode", false, "Enable dark mode UI");
+  auto max_connections =
+      flagpp::flags::define("max_connections", 100, "Maximum number of connections");
+  LockedValue locked;
+  locked.value = 100;
+
+  for (unsigned readers : bench::thread_counts(options)) {
+    for (unsigned writers : {0u, 1u, 2u}) {
+      std::vector<std::pair<std::string, std::string>> params = {
+          {"writers", std::to_string(writers)}};
+      auto update = [&](int i) {
+        dark_mode->update(i % 2 == 0);
+        max_connections->update(100 + i);
+      };
+
+      reporter.add(run(options, "flags::is_enabled+get_value", readers, writers,
+                       [] {
+                         return flagpp::flags::is_enabled("dark_mode") +
+                                flagpp::flags::get_value<int>("max_connections")
+                                    .value_or(0);
+                       },
+                       update),
+                   params);
+      reporter.add(run(options, "Flag::value", readers, writers,
+                       [&] { return static_cast<int>(max_connections->value()); },
+                       update),
+                   params);
+      reporter.add(run(options, "TypedFlag::load", readers, writers,
+                       [&] { return max_connections.load(); }, update),
+                   params);
+      reporter.add(run(options, "shared_mutex reference", readers, writers,
+                       [&] { return locked.read(); },
+                       [&](int i) { locked.write(100 + i); }),
+                   params);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <string>
+#include <vector>
+
+// Cost of per-thread evaluation counters on the read paths: the same
+// reads against a registry without counting and one with counting on.
+// The difference between the two rows of each pair is the per-read cost.
+// Rows with flags=1 re-read one flag, so each increment waits for the
+// previous store to the same counter; flags=64 rotates over a working set
+// as real call sites do.
+
+namespace {
+
+// `read(k)` performs the k-th of 64 reads per round
+template <typename Read>
+bench::Result run(const bench::Options& options, const char* name,
+                  unsigned threads, Read read) {
+  return bench::measure(options, name, threads,
+                        [&](unsigned, std::atomic<bool>& stop) {
+                          std::uint64_t ops = 0;
+                          while (!stop.load(std::memory_order_relaxed)) {
+                            for (std::size_t k = 0; k < 64; ++k, ++ops) {
+                              bench::do_not_optimize(read(k));
+                            }
+                          }
+                          return ops;
+                        });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  flagpp::FlagRegistry plain;
+  flagpp::FlagRegistry counted(flagpp::RegistryOptions{1, true});
+  const std::pair<flagpp::FlagRegistry*, const char*> registries[] = {
+      {&plain, "off"}, {&counted, "on"}};
+
+  for (unsigned threads : bench::thread_counts(options)) {
+    for (const auto& [registry, counting] : registries) {
+      auto enabled = registry->define("bench_counted_bool", true);
+      auto limit = registry->define("bench_counted_int", 42);
+
+      std::vector<flagpp::TypedFlag<bool>> working_set;
+      for (int i = 0; i < 64; ++i) {
+        working_set.push_back(
+            registry->define("bench_counted_" + std::to_string(i), i % 2 == 0));
+      }
+
+      reporter.add(run(options, "TypedFlag::load", threads,
+                       [&](std::size_t) { return enabled.load(); }),
+                   {{"counting", counting}, {"flags", "1"}});
+      reporter.add(run(options, "TypedFlag::load", threads,
+                       [&](std::size_t k) { return working_set[k].load(); }),
+                   {{"counting", counting}, {"flags", "64"}});
+      reporter.add(run(options, "Flag::value", threads,
+                       [&](std::size_t) { return static_cast<int>(limit->value()); }),
+                   {{"counting", counting}, {"flags", "1"}});
+      reporter.add(run(options, "Flag::is_enabled_for", threads,
+                       [&](std::size_t) { return enabled->is_enabled_for(std::uint64_t{7}); }),
+                   {{"counting", counting}, {"flags", "1"}});
+      reporter.add(
+          bench::measure(options, "FlagCache::is_enabled", threads,
+                         [&, registry = registry](unsigned, std::atomic<bool>& stop) {
+                           flagpp::FlagCache cache(*registry); // One per thread
+                           std::uint64_t ops = 0;
+                           while (!stop.load(std::memory_order_relaxed)) {
+                             for (int k = 0; k < 64; ++k, ++ops) {
+                               bench::do_not_optimize(
+                                   cache.is_enabled("bench_counted_bool"));
+                             }
+                           }
+                           return ops;
+                         }),
+          {{"counting", counting}, {"flags", "1"}});
+    }
+  }
+
+  return 0;
+}
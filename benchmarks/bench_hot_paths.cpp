@@ -0,0 +1,233 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+// ns/op for the read, update and lookup hot paths of the public API,
+// swept over thread counts, registry sizes and reader/writer ratios.
+
+namespace {
+
+const std::size_t kRegistrySizes[] = {10, 1000, 100000};
+const unsigned kWritePermille[] = {0, 10, 100, 500};
+
+std::string flag_name(std::size_t i) {
+  return "bench_flag_" + std::to_string(i);
+}
+
+// Grows the global registry to `size` flags and returns their names in a
+// shuffled order so lookups do not walk memory sequentially.
+std::vector<std::string> grow_global_registry(std::size_t size) {
+  std::vector<std::string> names;
+  names.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    names.push_back(flag_name(i));
+    flagpp::flags::define(names.back(), i % 2 == 0);
+  }
+  std::shuffle(names.begin(), names.end(), std::mt19937(42));
+  return names;
+}
+
+void bench_lookups(const bench::Options& options, bench::Reporter& reporter) {
+  for (std::size_t size : kRegistrySizes) {
+    auto names = grow_global_registry(size);
+    std::vector<std::string> int_names;
+    for (std::size_t i = 0; i < 16; ++i) {
+      int_names.push_back("bench_int_" + std::to_string(i));
+      flagpp::flags::define(int_names.back(), static_cast<int>(i));
+    }
+
+    for (unsigned threads : bench::thread_counts(options)) {
+      auto is_enabled = bench::measure(
+          options, "flags::is_enabled", threads,
+          [&](unsigned t, std::atomic<bool>& stop) {
+            std::uint64_t ops = 0;
+            std::size_t i = t * 7919;
+            while (!stop.load(std::memory_order_relaxed)) {
+              for (int k = 0; k < 64; ++k, ++ops) {
+                bench::do_not_optimize(
+                    flagpp::flags::is_enabled(names[i++ % names.size()]));
+              }
+            }
+            return ops;
+          });
+      reporter.add(is_enabled, {{"registry_size", std::to_string(size)}});
+
+      auto get_value = bench::measure(
+          options, "flags::get_value<int>", threads,
+          [&](unsigned t, std::atomic<bool>& stop) {
+            std::uint64_t ops = 0;
+            std::size_t i = t;
+            while (!stop.load(std::memory_order_relaxed)) {
+              for (int k = 0; k < 64; ++k, ++ops) {
+                bench::do_not_optimize(flagpp::flags::get_value<int>(
+                    int_names[i++ % int_names.size()]));
+              }
+            }
+            return ops;
+          });
+      reporter.add(get_value, {{"registry_size", std::to_string(size)}});
+    }
+  }
+}
+
+void bench_flag_access(const bench::Options& options,
+                       bench::Reporter& reporter) {
+  auto flag = flagpp::flags::define("bench_value", 1);
+  auto string_flag = flagpp::flags::define(
+      "bench_string", std::string("https://api.example.com/v1/endpoint"));
+
+  for (unsigned threads : bench::thread_counts(options)) {
+    reporter.add(bench::measure(options, "Flag::value", threads,
+                                [&](unsigned, std::atomic<bool>& stop) {
+                                  std::uint64_t ops = 0;
+                                  while (!stop.load(std::memory_order_relaxed)) {
+                                    for (int k = 0; k < 64; ++k, ++ops) {
+                                      bench::do_not_optimize(flag->value());
+                                    }
+                                  }
+                                  return ops;
+                                }),
+                 {{"type", "int"}});
+
+    reporter.add(bench::measure(options, "Flag::value", threads,
+                                [&](unsigned, std::atomic<bool>& stop) {
+                                  std::uint64_t ops = 0;
+                                  while (!stop.load(std::memory_order_relaxed)) {
+                                    for (int k = 0; k < 64; ++k, ++ops) {
+                                      bench::do_not_optimize(
+                                          string_flag->value());
+                                    }
+                                  }
+                                  return ops;
+                                }),
+                 {{"type", "string"}});
+
+    reporter.add(bench::measure(options, "Flag::string_ref", threads,
+                                [&](unsigned, std::atomic<bool>& stop) {
+                                  std::uint64_t ops = 0;
+                                  while (!stop.load(std::memory_order_relaxed)) {
+                                    for (int k = 0; k < 64; ++k, ++ops) {
+                                      bench::do_not_optimize(
+                                          string_flag->string_ref().size());
+                                    }
+                                  }
+                                  return ops;
+                                }),
+                 {{"type", "string"}});
+
+    reporter.add(bench::measure(options, "TypedFlag::load", threads,
+                                [&](unsigned, std::atomic<bool>& stop) {
+                                  std::uint64_t ops = 0;
+                                  while (!stop.load(std::memory_order_relaxed)) {
+                                    for (int k = 0; k < 64; ++k, ++ops) {
+                                      bench::do_not_optimize(flag.load());
+                                    }
+                                  }
+                                  return ops;
+                                }),
+                 {{"type", "int"}});
+
+    reporter.add(bench::measure(options, "Flag::update", threads,
+                                [&](unsigned t, std::atomic<bool>& stop) {
+                                  std::uint64_t ops = 0;
+                                  int v = static_cast<int>(t);
+                                  while (!stop.load(std::memory_order_relaxed)) {
+                                    for (int k = 0; k < 16; ++k, ++ops) {
+                                      flag->update(v++);
+                                    }
+                                  }
+                                  return ops;
+                                }),
+                 {{"type", "int"}});
+  }
+}
+
+void bench_mixed(const bench::Options& options, bench::Reporter& reporter) {
+  auto names = grow_global_registry(1000);
+
+  for (unsigned permille : kWritePermille) {
+    for (unsigned threads : bench::thread_counts(options)) {
+      auto result = bench::measure(
+          options, "mixed is_enabled/update", threads,
+          [&](unsigned t, std::atomic<bool>& stop) {
+            std::uint64_t ops = 0;
+            std::minstd_rand rng(t + 1);
+            while (!stop.load(std::memory_order_relaxed)) {
+              for (int k = 0; k < 64; ++k, ++ops) {
+                const std::string& name = names[rng() % names.size()];
+                if (rng() % 1000 < permille) {
+                  flagpp::flags::update(name, (ops & 1) != 0);
+                } else {
+                  bench::do_not_optimize(flagpp::flags::is_enabled(name));
+                }
+              }
+            }
+            return ops;
+          });
+      reporter.add(result, {{"write_permille", std::to_string(permille)}});
+    }
+  }
+}
+
+void bench_define(const bench::Options& options, bench::Reporter& reporter) {
+  for (std::size_t size : kRegistrySizes) {
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < size; ++i) {
+      names.push_back("define_flag_" + std::to_string(i));
+    }
+
+    // Fresh registries are filled until the time budget runs out
+    auto fresh = bench::measure(
+        options, "FlagRegistry::define (new)", 1,
+        [&](unsigned, std::atomic<bool>& stop) {
+          std::uint64_t ops = 0;
+          while (!stop.load(std::memory_order_relaxed)) {
+            flagpp::FlagRegistry registry;
+            for (const auto& name : names) {
+              registry.define(name, 1);
+            }
+            ops += names.size();
+          }
+          return ops;
+        });
+    reporter.add(fresh, {{"registry_size", std::to_string(size)}});
+
+    flagpp::FlagRegistry registry;
+    for (const auto& name : names) {
+      registry.define(name, 1);
+    }
+    for (unsigned threads : bench::thread_counts(options)) {
+      auto existing = bench::measure(
+          options, "FlagRegistry::define (existing)", threads,
+          [&](unsigned t, std::atomic<bool>& stop) {
+            std::uint64_t ops = 0;
+            std::size_t i = t * 7919;
+            while (!stop.load(std::memory_order_relaxed)) {
+              for (int k = 0; k < 16; ++k, ++ops) {
+                bench::do_not_optimize(
+                    registry.define(names[i++ % names.size()], 1));
+              }
+            }
+            return ops;
+          });
+      reporter.add(existing, {{"registry_size", std::to_string(size)}});
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  bench_flag_access(options, reporter);
+  bench_lookups(options, reporter);
+  bench_mixed(options, reporter);
+  bench_define(options, reporter);
+
+  return 0;
+}
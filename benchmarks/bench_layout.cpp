@@ -0,0 +1,86 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+// Scalar reads spread over a large working set of flags. The flags are
+// visited in a shuffled cycle, and each holds the position of the next
+// one in the visit order, so every read waits for the previous one and
+// the time per read is the cost of reaching the value. The handles are
+// laid out in visit order, so reaching the next handle is a sequential,
+// prefetched load and only the value layout is timed. TypedFlag::load
+// reads the dense ValueTable at 32 bytes per flag; Flag::scalar reads the
+// copy at the head of each Flag, the layout every read used before the
+// split. The bytes column is the memory the working set's values are
+// spread over.
+
+namespace {
+
+// Follows the cycle from the first handle; `read(k)` returns the
+// position after k
+template <typename Read>
+bench::Result run(const bench::Options& options, const char* name,
+                  std::size_t count, Read read) {
+  return bench::measure(options, name, 1, [&](unsigned, std::atomic<bool>& stop) {
+    std::uint64_t ops = 0;
+    std::uint32_t index = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      for (std::size_t k = 0; k < count; ++k) {
+        index = static_cast<std::uint32_t>(read(index));
+      }
+      ops += count;
+    }
+    bench::do_not_optimize(index);
+    return ops;
+  });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  for (std::size_t count : {1000, 10000, 100000}) {
+    // Flag order[k] is read k-th and holds k + 1
+    std::vector<std::uint32_t> order(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      order[i] = static_cast<std::uint32_t>(i);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    std::vector<int> next(count);
+    for (std::size_t k = 0; k < count; ++k) {
+      next[order[k]] = static_cast<int>((k + 1) % count);
+    }
+
+    // Defined in name order, so flags and table slots are laid out that way
+    flagpp::FlagRegistry registry;
+    std::vector<flagpp::TypedFlag<int>> defined;
+    for (std::size_t i = 0; i < count; ++i) {
+      defined.push_back(registry.define("bench_layout_" + std::to_string(i), next[i]));
+    }
+    std::vector<flagpp::TypedFlag<int>> handles;
+    for (std::size_t k = 0; k < count; ++k) {
+      handles.push_back(defined[order[k]]);
+    }
+
+    std::vector<std::pair<std::string, std::string>> dense = {
+        {"flags", std::to_string(count)},
+        {"bytes", std::to_string(count * sizeof(flagpp::detail::HotValue))}};
+    std::vector<std::pair<std::string, std::string>> embedded = {
+        {"flags", std::to_string(count)},
+        {"bytes", std::to_string(count * sizeof(flagpp::Flag))}};
+
+    reporter.add(run(options, "TypedFlag::load", count,
+                     [&](std::uint32_t i) { return handles[i].load(); }),
+                 dense);
+    reporter.add(run(options, "Flag::scalar", count,
+                     [&](std::uint32_t i) { return handles[i]->scalar<int>(); }),
+                 embedded);
+  }
+
+  return 0;
+}
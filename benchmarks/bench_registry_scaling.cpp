@@ -0,0 +1,61 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <string>
+#include <vector>
+
+// Measures how name lookup throughput scales with thread count for a
+// single-lock registry, a sharded one, and a frozen one.
+
+namespace {
+
+constexpr int kFlagCount = 1024;
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  std::vector<std::string> names;
+  for (int i = 0; i < kFlagCount; ++i) {
+    names.push_back("scaling_flag_" + std::to_string(i));
+  }
+
+  struct Config {
+    const char* label;
+    std::size_t shards;
+    bool frozen;
+  };
+  const Config configs[] = {
+      {"1 shard", 1, false}, {"64 shards", 64, false}, {"frozen", 1, true}};
+
+  for (const Config& config : configs) {
+    flagpp::FlagRegistry registry(flagpp::RegistryOptions{config.shards});
+    for (const auto& name : names) {
+      registry.define(name, true);
+    }
+    if (config.frozen) {
+      registry.freeze();
+    }
+
+    for (unsigned threads : bench::thread_counts(options)) {
+      auto result = bench::measure(
+          options, "FlagRegistry::exists", threads,
+          [&](unsigned t, std::atomic<bool>& stop) {
+            std::uint64_t ops = 0;
+            std::size_t i = t * 7919;
+            while (!stop.load(std::memory_order_relaxed)) {
+              for (int k = 0; k < 64; ++k, ++ops) {
+                bench::do_not_optimize(
+                    registry.exists(names[i++ % names.size()]));
+              }
+            }
+            return ops;
+          });
+      reporter.add(result, {{"registry", config.label}});
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <flagpp/bulk.hpp>
+#include <string>
+#include <vector>
+
+// Rollout evaluation throughput per core for string and numeric keys, and
+// bulk evaluation of numeric keys with each available kernel.
+
+namespace {
+
+constexpr std::size_t kKeyCount = 4096; // Power of two, indexed by mask
+
+template <typename Keys, typename Eval>
+bench::Result run(const bench::Options& options, const char* name,
+                  unsigned threads, const Keys& keys, Eval eval) {
+  return bench::measure(options, name, threads,
+                        [&](unsigned t, std::atomic<bool>& stop) {
+                          std::uint64_t ops = 0;
+                          std::size_t i = t * 131;
+                          while (!stop.load(std::memory_order_relaxed)) {
+                            for (int k = 0; k < 64; ++k, ++ops) {
+                              bench::do_not_optimize(
+                                  eval(keys[i++ & (keys.size() - 1)]));
+                            }
+                          }
+                          return ops;
+                        });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  std::vector<std::string> user_keys;
+  std::vector<std::uint64_t> user_ids;
+  for (std::size_t i = 0; i < kKeyCount; ++i) {
+    user_keys.push_back("user-" + std::to_string(1000003 * i));
+    user_ids.push_back(0x9e3779b97f4a7c15ULL * (i + 1));
+  }
+
+  auto on_off = flagpp::flags::define_rollout(
+      "bench_rollout_on_off", false, flagpp::Rollout::percentage(25.0, 7));
+  auto variants = flagpp::flags::define_rollout(
+      "bench_rollout_variants", std::string("control"),
+      flagpp::Rollout({{flagpp::FlagValue(std::string("A")), 20000},
+                       {flagpp::FlagValue(std::string("B")), 20000},
+                       {flagpp::FlagValue(std::string("C")), 20000}},
+                      7));
+  flagpp::Rollout rollout = flagpp::Rollout::percentage(25.0, 7);
+
+  for (unsigned threads : bench::thread_counts(options)) {
+    reporter.add(run(options, "Rollout::variant", threads, user_keys,
+                     [&](const std::string& key) {
+                       return rollout.variant(std::string_view(key));
+                     }),
+                 {{"key", "string"}});
+    reporter.add(run(options, "RolloutFlag::is_enabled", threads, user_keys,
+                     [&](const std::string& key) {
+                       return on_off.is_enabled(std::string_view(key));
+                     }),
+                 {{"key", "string"}});
+    reporter.add(run(options, "RolloutFlag::is_enabled", threads, user_ids,
+                     [&](std::uint64_t id) { return on_off.is_enabled(id); }),
+                 {{"key", "uint64"}});
+    reporter.add(run(options, "Flag::evaluate_in_guard", threads, user_keys,
+                     [&](const std::string& key) {
+                       flagpp::detail::EpochDomain::Guard guard;
+                       return variants->evaluate_in_guard(std::string_view(key))
+                           .index();
+                     }),
+                 {{"key", "string"}, {"variants", "3"}});
+
+    const std::pair<flagpp::SimdLevel, const char*> levels[] = {
+        {flagpp::SimdLevel::scalar, "scalar"},
+        {flagpp::SimdLevel::sse42, "sse4.2"},
+        {flagpp::SimdLevel::avx2, "avx2"}};
+    for (const auto& [level, simd] : levels) {
+      if (!flagpp::simd_supported(level)) {
+        continue;
+      }
+      reporter.add(
+          bench::measure(options, "bulk_is_enabled", threads,
+                         [&, level = level](unsigned, std::atomic<bool>& stop) {
+                           std::vector<std::uint64_t> bitmap(kKeyCount / 64);
+                           std::uint64_t ops = 0;
+                           while (!stop.load(std::memory_order_relaxed)) {
+                             flagpp::bulk_is_enabled(*on_off, user_ids.data(),
+                                                     kKeyCount, bitmap.data(),
+                                                     level);
+                             bench::do_not_optimize(bitmap[0]);
+                             ops += kKeyCount;
+                           }
+                           return ops;
+                         }),
+          {{"key", "uint64"}, {"simd", simd}});
+    }
+  }
+
+  return 0;
+}
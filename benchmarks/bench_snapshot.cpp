@@ -0,0 +1,98 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <flagpp/snapshot.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Startup cost of a 50k-flag registry: repeated define() calls against
+// loading a mapped snapshot. Each op builds a complete registry. Loaded
+// flags are constructed on first lookup, so the last row also looks up
+// every flag once, which is the cost a snapshot load defers.
+
+namespace {
+
+constexpr std::size_t kFlagCount = 50000;
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < kFlagCount; ++i) {
+    names.push_back("service.feature_" + std::to_string(i));
+  }
+  auto define_all = [&](flagpp::FlagRegistry& registry) {
+    for (std::size_t i = 0; i < kFlagCount; ++i) {
+      switch (i % 3) {
+      case 0:
+        registry.define(names[i], i % 2 == 0, "Boolean feature toggle");
+        break;
+      case 1:
+        registry.define(names[i], static_cast<int>(i), "Tuning parameter");
+        break;
+      default:
+        registry.define(names[i], std::string("https://example.com/endpoint"),
+                        "Service endpoint URL");
+        break;
+      }
+    }
+  };
+
+  const std::string path = "bench_snapshot.bin";
+  {
+    flagpp::FlagRegistry registry;
+    define_all(registry);
+    if (!flagpp::save_snapshot(registry, path)) {
+      std::fprintf(stderr, "cannot write %s\n", path.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<std::string, std::string>> params = {
+      {"flags", std::to_string(kFlagCount)}, {"op", "startup"}};
+  reporter.add(bench::measure(options, "FlagRegistry::define", 1,
+                              [&](unsigned, std::atomic<bool>& stop) {
+                                std::uint64_t ops = 0;
+                                while (!stop.load(std::memory_order_relaxed)) {
+                                  flagpp::FlagRegistry registry;
+                                  define_all(registry);
+                                  ++ops;
+                                }
+                                return ops;
+                              }),
+               params);
+  reporter.add(bench::measure(options, "load_snapshot", 1,
+                              [&](unsigned, std::atomic<bool>& stop) {
+                                std::uint64_t ops = 0;
+                                while (!stop.load(std::memory_order_relaxed)) {
+                                  flagpp::FlagRegistry registry;
+                                  bench::do_not_optimize(
+                                      flagpp::load_snapshot(registry, path));
+                                  ++ops;
+                                }
+                                return ops;
+                              }),
+               params);
+  params.back().second = "startup+get";
+  reporter.add(bench::measure(options, "load_snapshot", 1,
+                              [&](unsigned, std::atomic<bool>& stop) {
+                                std::uint64_t ops = 0;
+                                while (!stop.load(std::memory_order_relaxed)) {
+                                  flagpp::FlagRegistry registry;
+                                  flagpp::load_snapshot(registry, path);
+                                  for (const auto& name : names) {
+                                    bench::do_not_optimize(registry.get(name));
+                                  }
+                                  ++ops;
+                                }
+                                return ops;
+                              }),
+               params);
+
+  std::remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench_common.hpp"
+
+#include <flagpp.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wake-up latency from Flag::update to a consumer noticing the change:
+// a consumer blocked in wait_for_change() against one polling every
+// 100us. Reported as percentiles of the per-change latency.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Consume>
+std::vector<double> sample(const bench::Options& options, flagpp::Flag& flag,
+                           Consume consume) {
+  std::atomic<std::int64_t> sent{0};
+  std::atomic<bool> stop{false};
+  std::vector<double> latencies;
+
+  std::thread consumer([&] {
+    while (!stop.load(std::memory_order_acquire)) {
+      std::uint32_t version = flag.change_version();
+      if (consume(version)) {
+        auto now = Clock::now().time_since_epoch().count();
+        latencies.push_back(static_cast<double>(now - sent.load()));
+      }
+    }
+  });
+
+  auto end = Clock::now() + options.duration;
+  int value = 0;
+  while (Clock::now() < end) {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    sent.store(Clock::now().time_since_epoch().count());
+    flag.update(++value);
+  }
+  stop.store(true, std::memory_order_release);
+  sent.store(Clock::now().time_since_epoch().count());
+  flag.update(++value); // Releases a consumer that is still waiting
+  consumer.join();
+  return latencies;
+}
+
+void report(bench::Reporter& reporter, const char* name,
+            std::vector<double> latencies) {
+  if (latencies.empty()) {
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  for (auto [label, q] : {std::pair{"p50", 0.50}, {"p99", 0.99}, {"max", 1.0}}) {
+    bench::Result result;
+    result.name = name;
+    result.ops = latencies.size();
+    result.ns_per_op =
+        latencies[std::min(latencies.size() - 1,
+                           static_cast<std::size_t>(q * latencies.size()))];
+    result.mops_per_sec = 1e3 / result.ns_per_op;
+    reporter.add(result, {{"latency", label}});
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options = bench::parse_options(argc, argv);
+  bench::Reporter reporter(options);
+
+  auto flag = flagpp::flags::define("bench_wait_flag", 0);
+
+  report(reporter, "wait_for_change",
+         sample(options, *flag, [&](std::uint32_t version) {
+           return flag->wait_for_change(version, std::chrono::seconds(1));
+         }));
+  report(reporter, "poll_every_100us",
+         sample(options, *flag, [&](std::uint32_t version) {
+           while (flag->change_version() == version) {
+             std::this_thread::sleep_for(std::chrono::microseconds(100));
+           }
+           return true;
+         }));
+
+  return 0;
+}
@@ -38,8 +38,12 @@ int main() {
   std::cout << "\nUpdating flags...\n\n";
   flagpp::flags::update("dark_mode", false);
   flagpp::flags::update("max_connections", 200);
-  flagpp::flags::update("api_endpoint", std::string("https://api2.example.com"));
-  flagpp::flags::update("timeout_seconds", 60.0);
+
+  // Related flags change together: a snapshot sees both or neither
+  auto transaction = flagpp::flags::transaction();
+  transaction.set("api_endpoint", std::string("https://api2.example.com"));
+  transaction.set("timeout_seconds", 60.0);
+  transaction.commit();
   
   // Check the updated values
   std::cout << "Dark mode is " << (flagpp::flags::is_enabled("dark_mode") ? "enabled" : "disabled") << "\n";
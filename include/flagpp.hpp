@@ -18,268 +18,3866 @@
 #ifndef FLAGPP_HPP
 #define FLAGPP_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && \
+    __has_include(<coroutine>)
+#define FLAGPP_HAS_COROUTINES 1
+#include <coroutine>
+#endif
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Number of shards used by the global registry
+ *
+ * One shard reproduces a single registry-wide lock. Define this to a larger
+ * power of two before including the header to spread lookups across
+ * independently locked shards on many-core hosts.
+ */
+#ifndef FLAGPP_REGISTRY_SHARDS
+#define FLAGPP_REGISTRY_SHARDS 1
+#endif
+
+/**
+ * @brief Whether the global registry counts evaluations of its flags
+ *
+ * Define this to 1 before including the header to turn on per-thread
+ * evaluation counters for every flag defined in the global registry.
+ */
+#ifndef FLAGPP_COUNT_EVALUATIONS
+#define FLAGPP_COUNT_EVALUATIONS 0
+#endif
+
+// Keeps rarely taken paths out of inlined hot paths
+#if defined(__GNUC__)
+#define FLAGPP_COLD __attribute__((noinline, cold))
+#elif defined(_MSC_VER)
+#define FLAGPP_COLD __declspec(noinline)
+#else
+#define FLAGPP_COLD
+#endif
+
 namespace flagpp {
 
-/**
- * @brief Represents the possible types a feature flag can have
- */
-using FlagValue = std::variant<bool, int, double, std::string>;
+/**
+ * @brief Represents the possible types a feature flag can have
+ */
+using FlagValue = std::variant<bool, int, double, std::string>;
+
+/**
+ * @brief Type-safe wrapper for flag values with conversion operators
+ * 
+ * Provides type-safe access to the underlying flag value with
+ * convenient conversion operators for common types.
+ */
+class Value {
+private:
+  FlagValue value_;
+
+public:
+  /**
+   * @brief Construct a new Value object
+   * @tparam T The type of the value (must be compatible with FlagValue)
+   * @param value The value to store
+   */
+  template <typename T, 
+            typename = std::enable_if_t<
+              std::is_constructible_v<FlagValue, T>>>
+  explicit Value(T value) : value_(std::move(value)) {}
+
+  /**
+   * @brief Get the value as the specified type
+   * @tparam T The type to retrieve
+   * @return std::optional<T> The value if it matches the requested type, or nullopt
+   */
+  template <typename T>
+  std::optional<T> get() const {
+    if (std::holds_alternative<T>(value_)) {
+      return std::get<T>(value_);
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Convert to boolean
+   * @return bool The value as a boolean, or false if not a boolean
+   */
+  explicit operator bool() const {
+    auto val = get<bool>();
+    return val.has_value() ? *val : false;
+  }
+
+  /**
+   * @brief Convert to integer
+   * @return int The value as an integer, or 0 if not an integer
+   */
+  explicit operator int() const {
+    auto val = get<int>();
+    return val.has_value() ? *val : 0;
+  }
+
+  /**
+   * @brief Convert to double
+   * @return double The value as a double, or 0.0 if not a double
+   */
+  explicit operator double() const {
+    auto val = get<double>();
+    return val.has_value() ? *val : 0.0;
+  }
+
+  /**
+   * @brief Convert to string
+   * @return std::string The value as a string, or empty string if not a string
+   */
+  explicit operator std::string() const {
+    auto val = get<std::string>();
+    return val.has_value() ? *val : "";
+  }
+};
+
+namespace detail {
+
+/**
+ * @brief Assumed size of a cache line, used to keep hot data apart
+ */
+inline constexpr std::size_t cache_line_size = 64;
+
+/**
+ * @brief Process-wide generation counter
+ *
+ * Bumped by every Flag::update and every new definition, so a reader can
+ * tell with one relaxed load whether anything it cached may be stale.
+ */
+alignas(cache_line_size) inline std::atomic<std::uint64_t> generation{0};
+
+/**
+ * @brief Epoch-based reclamation domain for immutable snapshots
+ *
+ * Readers announce the current global epoch in a per-thread record for the
+ * duration of a read; writers retire replaced snapshots and only free them
+ * once every announcing reader has moved past the retirement epoch. A
+ * reader never writes to memory shared with other threads: its record
+ * lives on its own cache line.
+ */
+class EpochDomain {
+private:
+  struct alignas(cache_line_size) Record {
+    std::atomic<std::uint64_t> epoch{0}; // 0 while the thread is quiescent
+    std::atomic<bool> in_use{false};
+    Record* next = nullptr;
+    unsigned depth = 0; // Only touched by the owning thread
+  };
+
+  struct Retired {
+    const void* ptr;
+    void (*deleter)(const void*);
+    std::uint64_t epoch;
+  };
+
+  struct LocalRecord {
+    Record* record;
+    ~LocalRecord() { record->in_use.store(false, std::memory_order_release); }
+  };
+
+  std::atomic<std::uint64_t> epoch_{1};
+  std::atomic<Record*> records_{nullptr};
+  std::mutex retired_mutex_;
+  std::vector<Retired> retired_;
+
+  EpochDomain() = default;
+
+  Record* acquire_record() {
+    for (Record* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+      bool expected = false;
+      if (!r->in_use.load(std::memory_order_relaxed) &&
+          r->in_use.compare_exchange_strong(expected, true,
+                                            std::memory_order_acquire)) {
+        return r;
+      }
+    }
+
+    auto* record = new Record();
+    record->in_use.store(true, std::memory_order_relaxed);
+    Record* head = records_.load(std::memory_order_relaxed);
+    do {
+      record->next = head;
+    } while (!records_.compare_exchange_weak(head, record,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+    return record;
+  }
+
+  Record& local_record() {
+    thread_local LocalRecord local{acquire_record()};
+    return *local.record;
+  }
+
+  // Frees every retired snapshot no active reader can still observe.
+  // Must be called with retired_mutex_ held.
+  void collect_locked() {
+    std::uint64_t min_active = UINT64_MAX;
+    for (Record* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+      std::uint64_t e = r->epoch.load(std::memory_order_seq_cst);
+      if (e != 0 && e < min_active) {
+        min_active = e;
+      }
+    }
+
+    auto keep = retired_.begin();
+    for (auto it = retired_.begin(); it != retired_.end(); ++it) {
+      if (it->epoch < min_active) {
+        it->deleter(it->ptr);
+      } else {
+        *keep++ = *it;
+      }
+    }
+    retired_.erase(keep, retired_.end());
+  }
+
+public:
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  /**
+   * @brief Get the process-wide domain
+   *
+   * The domain is intentionally leaked so that snapshots retired during
+   * static destruction remain safe to hand over.
+   */
+  static EpochDomain& instance() {
+    static EpochDomain* domain = new EpochDomain();
+    return *domain;
+  }
+
+  /**
+   * @brief RAII read-side critical section
+   *
+   * Pointers loaded from an RCU-published atomic stay valid until the
+   * guard is destroyed. Guards nest.
+   */
+  class Guard {
+  private:
+    Record* record_;
+
+  public:
+    Guard() : record_(&instance().local_record()) {
+      if (record_->depth++ == 0) {
+        record_->epoch.store(
+            instance().epoch_.load(std::memory_order_acquire),
+            std::memory_order_seq_cst);
+      }
+    }
+
+    ~Guard() {
+      if (--record_->depth == 0) {
+        record_->epoch.store(0, std::memory_order_release);
+      }
+    }
+
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+  };
+
+  /**
+   * @brief Hand an unpublished snapshot over for deferred deletion
+   * @tparam T The snapshot type
+   * @param ptr The snapshot, already replaced in its atomic slot
+   */
+  template <typename T>
+  void retire(const T* ptr) {
+    std::lock_guard lock(retired_mutex_);
+    retired_.push_back({ptr,
+                        [](const void* p) { delete static_cast<const T*>(p); },
+                        epoch_.load(std::memory_order_relaxed)});
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    collect_locked();
+  }
+};
+
+/**
+ * @brief Final avalanche step of splitmix64
+ */
+constexpr std::uint64_t mix64(std::uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+constexpr std::uint64_t rotl64(std::uint64_t x, int r) noexcept {
+  return (x << r) | (x >> (64 - r));
+}
+
+// Reads up to eight bytes little-endian regardless of host byte order, so
+// hashes are stable across platforms
+constexpr std::uint64_t read_le(std::string_view s, std::size_t pos,
+                                std::size_t len) noexcept {
+  std::uint64_t word = 0;
+  for (std::size_t k = 0; k < len; ++k) {
+    word |= static_cast<std::uint64_t>(static_cast<unsigned char>(s[pos + k]))
+            << (8 * k);
+  }
+  return word;
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define FLAGPP_FAST_LOADS 1
+
+template <typename Word>
+inline Word load_word(const char* p) noexcept {
+  Word word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Same result as read_le(), using unaligned word loads. Short tails are
+// assembled from overlapping loads, which OR identical bytes together.
+inline std::uint64_t read_le_fast(std::string_view s, std::size_t pos,
+                                  std::size_t len) noexcept {
+  const char* p = s.data() + pos;
+  if (len == 8) {
+    return load_word<std::uint64_t>(p);
+  }
+  if (s.size() >= 8) {
+    return load_word<std::uint64_t>(s.data() + s.size() - 8) >> (64 - 8 * len);
+  }
+  if (len >= 4) {
+    return load_word<std::uint32_t>(p) |
+           (static_cast<std::uint64_t>(load_word<std::uint32_t>(p + len - 4))
+            << (8 * (len - 4)));
+  }
+  auto byte = [p](std::size_t k) {
+    return static_cast<std::uint64_t>(static_cast<unsigned char>(p[k]));
+  };
+  return byte(0) | (byte(len / 2) << (8 * (len / 2))) |
+         (byte(len - 1) << (8 * (len - 1)));
+}
+#endif
+
+/**
+ * @brief Seeded, stable 64-bit hash of a byte string
+ *
+ * Processes eight bytes per step and is usable in constant expressions.
+ * Not cryptographic.
+ */
+constexpr std::uint64_t hash_bytes(std::string_view s,
+                                   std::uint64_t seed = 0) noexcept {
+  constexpr std::uint64_t p1 = 0x9e3779b185ebca87ULL;
+  constexpr std::uint64_t p2 = 0xc2b2ae3d27d4eb4fULL;
+
+#ifdef FLAGPP_FAST_LOADS
+  const bool fast = !__builtin_is_constant_evaluated();
+#else
+  const bool fast = false;
+#endif
+  auto read = [&](std::size_t pos, std::size_t len) {
+#ifdef FLAGPP_FAST_LOADS
+    if (fast) {
+      return read_le_fast(s, pos, len);
+    }
+#endif
+    return read_le(s, pos, len);
+  };
+
+  std::uint64_t h = seed ^ (static_cast<std::uint64_t>(s.size()) * p1);
+  std::size_t pos = 0;
+  for (; pos + 8 <= s.size(); pos += 8) {
+    h ^= rotl64(read(pos, 8) * p2, 31) * p1;
+    h = rotl64(h, 27) * p1 + p2;
+  }
+  if (pos < s.size()) {
+    h ^= rotl64(read(pos, s.size() - pos) * p2, 31) * p1;
+  }
+  (void)fast;
+  return mix64(h);
+}
+
+/**
+ * @brief hash_bytes over the eight little-endian bytes of a 64-bit integer
+ *
+ * Bit-exact with hashing the integer's little-endian byte representation,
+ * without going through memory.
+ */
+constexpr std::uint64_t hash_u64(std::uint64_t value,
+                                 std::uint64_t seed = 0) noexcept {
+  constexpr std::uint64_t p1 = 0x9e3779b185ebca87ULL;
+  constexpr std::uint64_t p2 = 0xc2b2ae3d27d4eb4fULL;
+
+  std::uint64_t h = seed ^ (8 * p1);
+  h ^= rotl64(value * p2, 31) * p1;
+  h = rotl64(h, 27) * p1 + p2;
+  return mix64(h);
+}
+
+/**
+ * @brief A flag name paired with its precomputed hash
+ *
+ * Registry maps key on this so the hash computed to pick a shard is reused
+ * by the map lookup instead of hashing the name a second time.
+ */
+struct HashedName {
+  std::string_view name;
+  std::uint64_t hash;
+
+  explicit constexpr HashedName(std::string_view n)
+      : name(n), hash(hash_bytes(n)) {}
+
+  bool operator==(const HashedName& other) const noexcept {
+    return hash == other.hash && name == other.name;
+  }
+};
+
+struct HashedNameHash {
+  std::size_t operator()(const HashedName& key) const noexcept {
+    return static_cast<std::size_t>(key.hash);
+  }
+};
+
+/**
+ * @brief Immutable, reference-counted snapshot of a flag's value
+ *
+ * The owning Flag holds one reference while the node is current. Readers
+ * that only copy the value rely on an epoch guard instead of a reference;
+ * readers that keep the node past the guard (StringRef) take a reference.
+ * The last reference hands the node to the epoch domain, because a reader
+ * may still be inspecting the count under its guard.
+ */
+struct ValueNode {
+  FlagValue value;
+  mutable std::atomic<std::uint32_t> refs{1};
+  std::uint64_t version = 0; // Commit that published it; 0 for a default
+  // The value this one superseded, kept while a snapshot may still need it
+  mutable std::atomic<const ValueNode*> prev{nullptr};
+
+  explicit ValueNode(FlagValue v) : value(std::move(v)) {}
+
+  /**
+   * @brief Take a reference unless the count already reached zero
+   * @return bool False if the node is being retired
+   */
+  bool try_acquire() const noexcept {
+    std::uint32_t count = refs.load(std::memory_order_relaxed);
+    while (count != 0) {
+      if (refs.compare_exchange_weak(count, count + 1,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void release() const {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      EpochDomain::instance().retire(this);
+    }
+  }
+};
+
+/**
+ * @brief A flag's bool, int or double value, readable without an epoch guard
+ *
+ * Bool and int values are packed with their type into one word, so reading
+ * them is a single load with no type check: the int half is zero unless
+ * the value is an int, and the bool bit is clear unless it is a bool.
+ * A double needs its own word as well, so doubles are published under a
+ * sequence counter: the writer makes the counter odd, stores both words
+ * and makes it even again, and a reader loads the counter, the words and
+ * the counter once more, retrying if it was odd or moved. Words are
+ * stored with release and loaded with acquire, which orders the recheck
+ * without fences. On x86 every read is plain loads and no
+ * read-modify-writes, so readers never contend with each other.
+ *
+ * There must be one writer at a time; a Flag serialises its writes.
+ */
+class ScalarCell {
+private:
+  // FlagValue indices
+  static constexpr std::uint64_t bool_type = 0;
+  static constexpr std::uint64_t int_type = 1;
+  static constexpr std::uint64_t double_type = 2;
+  static constexpr std::uint64_t string_type = 3;
+
+  std::atomic<std::uint32_t> sequence_{0};
+  std::atomic<std::uint64_t> packed_{string_type << 40}; // type << 40 | bool << 32 | int
+  std::atomic<std::uint64_t> bits_{0};                    // double
+
+  static double to_double(std::uint64_t bits) noexcept {
+    double d;
+    std::memcpy(&d, &bits, sizeof(double));
+    return d;
+  }
+
+  // Reads a double consistently with its type; false if it is no longer one
+  bool read_double(double& out) const noexcept {
+    for (;;) {
+      std::uint32_t before = sequence_.load(std::memory_order_acquire);
+      std::uint64_t packed = packed_.load(std::memory_order_acquire);
+      std::uint64_t bits = bits_.load(std::memory_order_acquire);
+      if ((before & 1) == 0 && sequence_.load(std::memory_order_relaxed) == before) {
+        out = to_double(bits);
+        return packed >> 40 == double_type;
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief Publish a value; strings are recorded as "not a scalar"
+   * @param value The flag's new value
+   */
+  void store(const FlagValue& value) noexcept {
+    std::uint64_t packed = static_cast<std::uint64_t>(value.index()) << 40;
+    std::uint64_t bits = 0;
+    if (const auto* b = std::get_if<bool>(&value)) {
+      packed |= std::uint64_t{*b} << 32;
+    } else if (const auto* i = std::get_if<int>(&value)) {
+      packed |= static_cast<std::uint32_t>(*i);
+    } else if (const auto* d = std::get_if<double>(&value)) {
+      std::memcpy(&bits, d, sizeof(double));
+    }
+    std::uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    packed_.store(packed, std::memory_order_release);
+    bits_.store(bits, std::memory_order_release);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /**
+   * @brief Read the value as one type
+   * @tparam T bool, int or double
+   * @return T The value, or the type's default if the flag holds another type
+   */
+  template <typename T>
+  T load() const noexcept {
+    if constexpr (std::is_same_v<T, bool>) {
+      return (packed_.load(std::memory_order_acquire) >> 32 & 1) != 0;
+    } else if constexpr (std::is_same_v<T, int>) {
+      return static_cast<int>(static_cast<std::uint32_t>(packed_.load(std::memory_order_acquire)));
+    } else {
+      double d;
+      return read_double(d) ? d : 0.0;
+    }
+  }
+
+  /**
+   * @brief Read the value if it is a scalar
+   * @param out Receives the value
+   * @return bool False if the flag holds a string
+   */
+  bool load(FlagValue& out) const noexcept {
+    std::uint64_t packed = packed_.load(std::memory_order_acquire);
+    switch (packed >> 40) {
+    case bool_type:
+      out = (packed >> 32 & 1) != 0;
+      return true;
+    case int_type:
+      out = static_cast<int>(static_cast<std::uint32_t>(packed));
+      return true;
+    case double_type: {
+      double d;
+      if (read_double(d)) {
+        out = d;
+        return true;
+      }
+      return load(out); // Changed type meanwhile
+    }
+    default:
+      return false;
+    }
+  }
+};
+
+/**
+ * @brief Global commit order of flag writes and the versions snapshots pin
+ *
+ * Transactions commit under one mutex at the next version, so a set of
+ * values written together becomes visible to snapshots all at once.
+ * Snapshots pin the last committed version; writers keep superseded
+ * values linked behind the current one for as long as a pin may need them.
+ * While nothing is pinned, a write to a single flag has no history to
+ * keep and no version to order against, so it skips the mutex: see
+ * enter_single().
+ */
+class VersionClock {
+public:
+  struct alignas(cache_line_size) Pin {
+    std::atomic<std::uint64_t> version{0}; // Pinned version + 1, or 0
+    std::atomic<bool> in_use{false};
+    Pin* next = nullptr;
+  };
+
+  std::mutex commit_mutex;
+  std::atomic<std::uint64_t> committed{0};
+
+private:
+  static constexpr std::uint64_t pin_unit = std::uint64_t{1} << 32;
+
+  std::atomic<Pin*> pins_{nullptr};
+  // Single-flag writes in progress in the low half, pinned snapshots in
+  // the high half
+  alignas(cache_line_size) std::atomic<std::uint64_t> gate_{0};
+
+  VersionClock() = default;
+
+public:
+  VersionClock(const VersionClock&) = delete;
+  VersionClock& operator=(const VersionClock&) = delete;
+
+  /**
+   * @brief Get the process-wide clock; leaked like EpochDomain
+   */
+  static VersionClock& instance() {
+    static VersionClock* clock = new VersionClock();
+    return *clock;
+  }
+
+  /**
+   * @brief Pin the last committed version
+   * @param version Receives the pinned version
+   * @return Pin* The slot to pass to unpin()
+   */
+  Pin* pin(std::uint64_t& version) {
+    // Turn later single-flag writes onto the mutex and let those already
+    // past the gate finish
+    gate_.fetch_add(pin_unit, std::memory_order_seq_cst);
+    while ((gate_.load(std::memory_order_acquire) & (pin_unit - 1)) != 0) {
+      std::this_thread::yield();
+    }
+
+    Pin* slot = nullptr;
+    for (Pin* p = pins_.load(std::memory_order_acquire); p && !slot; p = p->next) {
+      bool expected = false;
+      if (!p->in_use.load(std::memory_order_relaxed) &&
+          p->in_use.compare_exchange_strong(expected, true,
+                                            std::memory_order_acquire)) {
+        slot = p;
+      }
+    }
+    if (!slot) {
+      slot = new Pin();
+      slot->in_use.store(true, std::memory_order_relaxed);
+      Pin* head = pins_.load(std::memory_order_relaxed);
+      do {
+        slot->next = head;
+      } while (!pins_.compare_exchange_weak(head, slot, std::memory_order_release,
+                                            std::memory_order_relaxed));
+    }
+
+    // Publish, then confirm no commit slipped in before a writer could
+    // have seen the pin
+    version = committed.load(std::memory_order_seq_cst);
+    for (;;) {
+      slot->version.store(version + 1, std::memory_order_seq_cst);
+      std::uint64_t now = committed.load(std::memory_order_seq_cst);
+      if (now == version) {
+        return slot;
+      }
+      version = now;
+    }
+  }
+
+  void unpin(Pin* slot) noexcept {
+    slot->version.store(0, std::memory_order_release);
+    slot->in_use.store(false, std::memory_order_release);
+    gate_.fetch_sub(pin_unit, std::memory_order_release);
+  }
+
+  /**
+   * @brief Start a single-flag write that skips the commit mutex
+   * @return bool False while a snapshot is pinned; the write must then commit
+   *         under the mutex
+   */
+  bool enter_single() noexcept {
+    if (gate_.fetch_add(1, std::memory_order_seq_cst) < pin_unit) {
+      return true;
+    }
+    leave_single();
+    return false;
+  }
+
+  void leave_single() noexcept { gate_.fetch_sub(1, std::memory_order_release); }
+
+  /**
+   * @brief Get the oldest version any snapshot still reads
+   * @param current The version just committed
+   * @return std::uint64_t The oldest pinned version, or current if none is older
+   */
+  std::uint64_t oldest_pinned(std::uint64_t current) const noexcept {
+    for (Pin* p = pins_.load(std::memory_order_acquire); p; p = p->next) {
+      std::uint64_t pinned = p->version.load(std::memory_order_seq_cst);
+      if (pinned != 0 && pinned - 1 < current) {
+        current = pinned - 1;
+      }
+    }
+    return current;
+  }
+};
+
+/**
+ * @brief Per-thread evaluation counters, summed on demand
+ *
+ * Each counting flag gets an id. Every thread owns an array of counters
+ * indexed by id and bumps its own with a relaxed load and store, never a
+ * read-modify-write, so readers on different cores share nothing. Arrays
+ * of exited threads are handed to new threads with their counts intact.
+ * Ids are not reused.
+ */
+class EvaluationCounters {
+private:
+  using Count = std::atomic<std::uint64_t>;
+
+  struct alignas(cache_line_size) Block {
+    std::atomic<Count*> counts{nullptr}; // Grown only by the owning thread
+    std::atomic<std::size_t> capacity{0};
+    std::atomic<bool> in_use{false};
+    Block* next = nullptr;
+  };
+
+  // The calling thread's array; trivially constructible, so reaching it
+  // costs no initialisation check
+  struct Local {
+    Count* counts;
+    std::size_t capacity;
+    Block* block;
+  };
+
+  struct LocalBlock {
+    Block* block = nullptr;
+    ~LocalBlock() {
+      if (block) {
+        block->in_use.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  std::atomic<std::uint32_t> next_id_{1}; // 0 means not counting
+  std::atomic<Block*> blocks_{nullptr};
+
+  constexpr EvaluationCounters() = default;
+
+  static Local& local() noexcept {
+    static thread_local Local state{nullptr, 0, nullptr};
+    return state;
+  }
+
+  Block* acquire_block() {
+    for (Block* b = blocks_.load(std::memory_order_acquire); b; b = b->next) {
+      bool expected = false;
+      if (!b->in_use.load(std::memory_order_relaxed) &&
+          b->in_use.compare_exchange_strong(expected, true,
+                                            std::memory_order_acquire)) {
+        return b;
+      }
+    }
+
+    auto* block = new Block();
+    block->in_use.store(true, std::memory_order_relaxed);
+    Block* head = blocks_.load(std::memory_order_relaxed);
+    do {
+      block->next = head;
+    } while (!blocks_.compare_exchange_weak(head, block, std::memory_order_release,
+                                            std::memory_order_relaxed));
+    return block;
+  }
+
+  // Attaches a block to the calling thread or grows its array to cover
+  // the id. A replaced array is never freed: a concurrent totals() may
+  // still be reading it, and growth is geometric.
+  FLAGPP_COLD Count& slow_counter(std::uint32_t id) {
+    Local& state = local();
+    if (!state.block) {
+      thread_local LocalBlock owner;
+      owner.block = acquire_block();
+      state.block = owner.block;
+      state.counts = state.block->counts.load(std::memory_order_relaxed);
+      state.capacity = state.block->capacity.load(std::memory_order_relaxed);
+    }
+    if (id >= state.capacity) {
+      std::size_t capacity = std::max<std::size_t>(64, state.capacity);
+      while (capacity <= id) {
+        capacity *= 2;
+      }
+      Count* counts = new Count[capacity]();
+      for (std::size_t i = 0; i < state.capacity; ++i) {
+        counts[i].store(state.counts[i].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+      }
+      // Publish the array before the capacity that covers it
+      state.block->counts.store(counts, std::memory_order_release);
+      state.block->capacity.store(capacity, std::memory_order_release);
+      state.counts = counts;
+      state.capacity = capacity;
+    }
+    return state.counts[id];
+  }
+
+  static void bump(Count& count, std::uint64_t n) noexcept {
+    count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  // Reads a block's array and a capacity it is known to cover
+  static std::pair<const Count*, std::size_t> view(const Block& block) noexcept {
+    std::size_t capacity = block.capacity.load(std::memory_order_acquire);
+    return {block.counts.load(std::memory_order_acquire), capacity};
+  }
+
+public:
+  EvaluationCounters(const EvaluationCounters&) = delete;
+  EvaluationCounters& operator=(const EvaluationCounters&) = delete;
+
+  /**
+   * @brief Get the process-wide counters
+   *
+   * Constant-initialised and trivially destructible, so reaching it costs
+   * no initialisation check and it outlives every reader. Blocks and
+   * arrays are never freed.
+   */
+  static EvaluationCounters& instance() {
+    static EvaluationCounters counters;
+    return counters;
+  }
+
+  /**
+   * @brief Reserve a counter id
+   * @return std::uint32_t The id, or 0 if every id is taken
+   */
+  std::uint32_t allocate() {
+    std::uint32_t id = next_id_.load(std::memory_order_relaxed);
+    do {
+      if (id == UINT32_MAX) {
+        return 0;
+      }
+    } while (!next_id_.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+    return id;
+  }
+
+  /**
+   * @brief Count evaluations on the calling thread
+   * @param id A counter id from allocate()
+   * @param n Number of evaluations
+   */
+  void increment(std::uint32_t id, std::uint64_t n = 1) {
+    Local& state = local();
+    bump(id < state.capacity ? state.counts[id] : slow_counter(id), n);
+  }
+
+  /**
+   * @brief Sum every thread's counters
+   * @return std::vector<std::uint64_t> Totals indexed by counter id
+   */
+  std::vector<std::uint64_t> totals() const {
+    std::vector<std::uint64_t> result(next_id_.load(std::memory_order_relaxed), 0);
+    for (Block* b = blocks_.load(std::memory_order_acquire); b; b = b->next) {
+      auto [counts, capacity] = view(*b);
+      std::size_t end = std::min(result.size(), capacity);
+      for (std::size_t id = 0; id < end; ++id) {
+        result[id] += counts[id].load(std::memory_order_relaxed);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief Sum every thread's counter for one id
+   * @param id A counter id from allocate()
+   * @return std::uint64_t The total
+   */
+  std::uint64_t total(std::uint32_t id) const {
+    std::uint64_t sum = 0;
+    for (Block* b = blocks_.load(std::memory_order_acquire); b; b = b->next) {
+      auto [counts, capacity] = view(*b);
+      if (id < capacity) {
+        sum += counts[id].load(std::memory_order_relaxed);
+      }
+    }
+    return sum;
+  }
+};
+
+/**
+ * @brief The part of a flag that every scalar read touches
+ *
+ * Each Flag holds one at its head and a copy in the ValueTable. A read of
+ * the copy brings in half a cache line shared with one other flag, rather
+ * than a line of a Flag whose names, rollout, subscribers and mutex are
+ * cold. Values are not padded to a line of their own: readers never write
+ * them, a write to the neighbour is rare, and padding doubled the table
+ * without making reads any faster.
+ */
+struct alignas(32) HotValue {
+  ScalarCell scalar;
+  std::atomic<std::uint32_t> counter{0}; // Evaluation counter id, 0 if not counting
+
+  /**
+   * @brief Count the read, if counting is enabled, and load the value
+   * @tparam T bool, int or double
+   */
+  template <typename T>
+  T read() const noexcept {
+    if (std::uint32_t id = counter.load(std::memory_order_relaxed)) {
+      EvaluationCounters::instance().increment(id);
+    }
+    return scalar.load<T>();
+  }
+};
+
+static_assert(sizeof(HotValue) == 32, "two hot values per cache line");
+
+/**
+ * @brief Dense storage for the hot values of every live flag
+ *
+ * Values are handed out from cache-line-aligned chunks that are never
+ * moved or freed, so a flag's slot keeps its address and flags created
+ * together sit next to each other. Slots of destroyed flags are reused.
+ */
+class ValueTable {
+private:
+  static constexpr std::size_t chunk_size = 1024; // 32 KiB
+
+  struct alignas(cache_line_size) Chunk {
+    HotValue values[chunk_size];
+  };
+
+  std::mutex mutex_;
+  std::vector<Chunk*> chunks_;
+  std::size_t used_ = chunk_size; // Slots handed out from the last chunk
+  std::vector<HotValue*> free_;
+
+  ValueTable() = default;
+
+public:
+  ValueTable(const ValueTable&) = delete;
+  ValueTable& operator=(const ValueTable&) = delete;
+
+  /**
+   * @brief Get the process-wide table; never destroyed, so flags may
+   *        outlive static destruction
+   */
+  static ValueTable& instance() {
+    static ValueTable* table = new ValueTable();
+    return *table;
+  }
+
+  /**
+   * @brief Take a slot for a new flag
+   * @return HotValue* The slot, with counting off
+   */
+  HotValue* acquire() {
+    std::lock_guard lock(mutex_);
+    if (!free_.empty()) {
+      HotValue* value = free_.back();
+      free_.pop_back();
+      return value;
+    }
+    if (used_ == chunk_size) {
+      chunks_.push_back(new Chunk());
+      used_ = 0;
+    }
+    return &chunks_.back()->values[used_++];
+  }
+
+  /**
+   * @brief Return a destroyed flag's slot
+   * @param value A slot from acquire() that nothing reads any more
+   */
+  void release(HotValue* value) {
+    value->counter.store(0, std::memory_order_relaxed);
+    std::lock_guard lock(mutex_);
+    free_.push_back(value);
+  }
+};
+
+/**
+ * @brief Monotonic arena for a registry's flags, names and map nodes
+ *
+ * Allocation bumps a pointer through geometrically growing blocks and
+ * freeing is a no-op; the blocks are returned when the arena is destroyed.
+ * It is owned jointly by the registry and by every flag allocated from it
+ * (through ArenaAllocator in the flag's control block), so a handle that
+ * outlives its registry keeps the flag's memory alive.
+ */
+class Arena final : public std::pmr::memory_resource {
+private:
+  std::mutex mutex_; // Shards define flags concurrently
+  std::pmr::monotonic_buffer_resource buffer_;
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    std::lock_guard lock(mutex_);
+    return buffer_.allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  /**
+   * @brief Construct an arena
+   * @param initial_size Size of the first block in bytes
+   */
+  explicit Arena(std::size_t initial_size = 64 * 1024) : buffer_(initial_size) {}
+
+  /**
+   * @brief Copy two strings into one allocation
+   * @return std::pair<std::string_view, std::string_view> Views of the copies
+   */
+  std::pair<std::string_view, std::string_view> copy(std::string_view first,
+                                                     std::string_view second) {
+    char* data = static_cast<char*>(allocate(first.size() + second.size(), 1));
+    std::memcpy(data, first.data(), first.size());
+    std::memcpy(data + first.size(), second.data(), second.size());
+    return {{data, first.size()}, {data + first.size(), second.size()}};
+  }
+};
+
+/**
+ * @brief Allocator that draws from an Arena and keeps it alive
+ */
+template <typename T>
+struct ArenaAllocator {
+  using value_type = T;
+
+  std::shared_ptr<Arena> arena;
+
+  explicit ArenaAllocator(std::shared_ptr<Arena> a) noexcept : arena(std::move(a)) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, std::size_t) noexcept {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const noexcept {
+    return arena == other.arena;
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const noexcept {
+    return arena != other.arena;
+  }
+};
+
+/**
+ * @brief Maps a default value type onto the FlagValue alternative it is stored as
+ */
+template <typename T>
+using flag_storage_t = std::conditional_t<
+    std::is_same_v<std::decay_t<T>, bool>, bool,
+    std::conditional_t<
+        std::is_integral_v<std::decay_t<T>>, int,
+        std::conditional_t<std::is_floating_point_v<std::decay_t<T>>, double,
+                           std::string>>>;
+
+} // namespace detail
+
+/**
+ * @brief Parse a dotted version such as "5.2.1" into a comparable number
+ *
+ * Up to three components of at most six digits each are packed into a
+ * double, so versions compare correctly with numeric rule operators
+ * ("5.10" is greater than "5.2"). Parsing stops at the first character
+ * that is neither a digit nor a dot.
+ *
+ * @param text The version
+ * @return double The packed version
+ */
+constexpr double version(std::string_view text) noexcept {
+  double parts[3] = {0, 0, 0};
+  std::size_t part = 0;
+  for (char c : text) {
+    if (c == '.') {
+      if (++part == 3) {
+        break;
+      }
+    } else if (c >= '0' && c <= '9') {
+      parts[part] = parts[part] * 10 + (c - '0');
+    } else {
+      break;
+    }
+  }
+  return parts[0] * 1e12 + parts[1] * 1e6 + parts[2];
+}
+
+/**
+ * @brief A named, typed attribute of an evaluation context
+ *
+ * String values are viewed, not copied, and must outlive the context.
+ * Booleans and integers are stored as numbers.
+ */
+struct Attribute {
+  enum class Kind : std::uint8_t { number, string };
+
+  std::uint64_t id; // detail::hash_bytes of the name
+  Kind kind;
+  double number = 0;
+  std::string_view text;
+
+  constexpr Attribute(std::string_view name, std::string_view value) noexcept
+      : id(detail::hash_bytes(name)), kind(Kind::string), text(value) {}
+
+  constexpr Attribute(std::string_view name, const char* value) noexcept
+      : Attribute(name, std::string_view(value)) {}
+
+  template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+  constexpr Attribute(std::string_view name, T value) noexcept
+      : id(detail::hash_bytes(name)), kind(Kind::number),
+        number(static_cast<double>(value)) {}
+};
+
+/**
+ * @brief Per-request inputs to flag evaluation
+ *
+ * Does not own its attributes; the array must outlive the context.
+ */
+struct EvaluationContext {
+  /**
+   * @brief Key that rollouts bucket on: a user id, tenant id, ...
+   */
+  std::string_view key;
+
+  /**
+   * @brief Attributes that targeting rules test
+   */
+  const Attribute* attributes = nullptr;
+  std::size_t attribute_count = 0;
+
+  EvaluationContext() = default;
+
+  EvaluationContext(std::string_view key) noexcept : key(key) {}
+
+  EvaluationContext(std::string_view key, const Attribute* attributes,
+                    std::size_t count) noexcept
+      : key(key), attributes(attributes), attribute_count(count) {}
+
+  template <std::size_t N>
+  EvaluationContext(std::string_view key, const Attribute (&attributes)[N]) noexcept
+      : EvaluationContext(key, attributes, N) {}
+
+  /**
+   * @brief Find an attribute by the hash of its name
+   * @param id detail::hash_bytes of the attribute's name
+   * @return const Attribute* The attribute, or nullptr if absent
+   */
+  const Attribute* find(std::uint64_t id) const noexcept {
+    for (std::size_t i = 0; i < attribute_count; ++i) {
+      if (attributes[i].id == id) {
+        return &attributes[i];
+      }
+    }
+    return nullptr;
+  }
+};
+
+/**
+ * @brief Percentage rollout of a flag across per-request keys
+ *
+ * A key (user id, tenant id, ...) is hashed with a stable, seeded hash into
+ * one of 100,000 buckets. Variants claim consecutive bucket ranges by
+ * weight; keys that fall past the last variant get the flag's own value.
+ * Evaluation allocates nothing and gives the same answer for a key on
+ * every host and run as long as the seed and weights are unchanged.
+ */
+class Rollout {
+public:
+  /**
+   * @brief Number of buckets keys are hashed into
+   */
+  static constexpr std::uint32_t buckets = 100000;
+
+  /**
+   * @brief A value and the number of buckets that receive it
+   */
+  struct Variant {
+    FlagValue value;
+    std::uint32_t weight;
+  };
+
+  /**
+   * @brief Sentinel index for keys that get the flag's own value
+   */
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+private:
+  std::uint64_t seed_ = 0;
+  std::vector<FlagValue> values_;
+  std::vector<std::uint32_t> bounds_; // Cumulative, exclusive upper bucket
+
+public:
+  /**
+   * @brief Construct a rollout
+   * @param variants Values and their weights in buckets; weights beyond
+   *        the 100,000 buckets are clamped
+   * @param seed Hash seed; change it to reshuffle which keys are selected
+   */
+  explicit Rollout(std::vector<Variant> variants, std::uint64_t seed = 0)
+      : seed_(seed) {
+    std::uint32_t upper = 0;
+    for (auto& variant : variants) {
+      upper = std::min(buckets, upper + std::min(variant.weight, buckets));
+      values_.push_back(std::move(variant.value));
+      bounds_.push_back(upper);
+    }
+  }
+
+  /**
+   * @brief On/off rollout enabling a percentage of keys
+   * @param percent Share of keys that see true, from 0 to 100
+   * @param seed Hash seed
+   * @return Rollout A rollout with a single `true` variant
+   */
+  static Rollout percentage(double percent, std::uint64_t seed = 0) {
+    double clamped = std::min(100.0, std::max(0.0, percent));
+    auto weight = static_cast<std::uint32_t>(clamped * (buckets / 100) + 0.5);
+    return Rollout({{FlagValue(true), weight}}, seed);
+  }
+
+  std::uint64_t seed() const noexcept { return seed_; }
+
+  /**
+   * @brief Map a hash onto a bucket
+   */
+  static constexpr std::uint32_t bucket_of_hash(std::uint64_t hash) noexcept {
+    return static_cast<std::uint32_t>(((hash >> 32) * buckets) >> 32);
+  }
+
+  /**
+   * @brief Get the bucket a key falls into
+   * @param key The per-request key
+   * @return std::uint32_t A bucket in [0, buckets)
+   */
+  std::uint32_t bucket(std::string_view key) const noexcept {
+    return bucket_of_hash(detail::hash_bytes(key, seed_));
+  }
+
+  /**
+   * @brief Get the bucket a numeric key falls into
+   *
+   * Same as bucket() on the key's eight little-endian bytes.
+   *
+   * @param key The per-request key
+   * @return std::uint32_t A bucket in [0, buckets)
+   */
+  std::uint32_t bucket(std::uint64_t key) const noexcept {
+    return bucket_of_hash(detail::hash_u64(key, seed_));
+  }
+
+  /**
+   * @brief Get the variant a bucket selects
+   * @param bucket A bucket in [0, buckets)
+   * @return std::size_t The variant's index, or npos for the flag's own value
+   */
+  std::size_t variant_of_bucket(std::uint32_t bucket) const noexcept {
+    std::size_t index = 0;
+    for (std::uint32_t bound : bounds_) {
+      index += bucket >= bound;
+    }
+    return index < bounds_.size() ? index : npos;
+  }
+
+  /**
+   * @brief Get the variant a key selects
+   * @tparam Key std::string_view or std::uint64_t
+   * @param key The per-request key
+   * @return std::size_t The variant's index, or npos for the flag's own value
+   */
+  template <typename Key>
+  std::size_t variant(const Key& key) const noexcept {
+    return variant_of_bucket(bucket(key));
+  }
+
+  /**
+   * @brief Get the variant an evaluation context selects
+   * @param context The evaluation context; its key is bucketed
+   * @return std::size_t The variant's index, or npos for the flag's own value
+   */
+  std::size_t variant(const EvaluationContext& context) const noexcept {
+    return variant(context.key);
+  }
+
+  /**
+   * @brief Get a variant's value
+   * @param index An index returned by variant()
+   * @return const FlagValue& The variant's value
+   */
+  const FlagValue& value(std::size_t index) const { return values_[index]; }
+
+  /**
+   * @brief Get the exclusive upper bucket of a variant's range
+   * @param index A variant index
+   * @return std::uint32_t The first bucket past the variant's range
+   */
+  std::uint32_t upper_bound(std::size_t index) const { return bounds_[index]; }
+
+  std::size_t size() const noexcept { return values_.size(); }
+};
+
+/**
+ * @brief A test of one context attribute against literal operands
+ *
+ * A condition on an attribute the context lacks never holds. Operands of
+ * a different kind than the attribute never match.
+ */
+struct Condition {
+  enum class Op : std::uint8_t {
+    equals,
+    not_equals,
+    in,
+    not_in,
+    less,
+    less_equal,
+    greater,
+    greater_equal
+  };
+
+  /**
+   * @brief A literal number, version() or string
+   */
+  struct Operand {
+    Attribute::Kind kind;
+    double number = 0;
+    std::string text;
+
+    Operand(const char* value) : kind(Attribute::Kind::string), text(value) {}
+    Operand(std::string value)
+        : kind(Attribute::Kind::string), text(std::move(value)) {}
+    Operand(std::string_view value)
+        : kind(Attribute::Kind::string), text(value) {}
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    Operand(T value)
+        : kind(Attribute::Kind::number), number(static_cast<double>(value)) {}
+  };
+
+  std::string attribute;
+  Op op;
+  std::vector<Operand> operands; // in/not_in test against any of them
+};
+
+/**
+ * @brief Conditions that must all hold to select a value
+ */
+struct Rule {
+  std::vector<Condition> conditions;
+  FlagValue value;
+};
+
+/**
+ * @brief Targeting rules compiled into a flat program
+ *
+ * Rules are tried in order and the first whose conditions all hold
+ * selects its value. Compilation resolves attribute names to hashes and
+ * operators to bit masks, and packs every condition into one instruction
+ * array with a shared operand pool. Evaluation interprets that program
+ * without allocating, and folds each comparison into a three-way outcome
+ * tested against the mask instead of branching per operator.
+ */
+class RuleSet {
+public:
+  /**
+   * @brief Sentinel index for contexts that match no rule
+   */
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+private:
+  // Three-way comparison outcomes, and an instruction flag that inverts
+  // the result
+  static constexpr std::uint8_t less_bit = 1;
+  static constexpr std::uint8_t equal_bit = 2;
+  static constexpr std::uint8_t greater_bit = 4;
+  static constexpr std::uint8_t negate_bit = 8;
+
+  struct Operand {
+    double number;
+    std::uint32_t offset; // Into text_
+    std::uint32_t size;
+    Attribute::Kind kind;
+  };
+
+  struct Instruction {
+    std::uint64_t attribute;
+    std::uint32_t first; // Into operands_
+    std::uint32_t count;
+    std::uint8_t mask;
+  };
+
+  std::vector<Instruction> program_;
+  std::vector<Operand> operands_;
+  std::string text_;
+  std::vector<std::uint32_t> ends_; // Exclusive end of each rule in program_
+  std::vector<FlagValue> values_;
+
+  static std::uint8_t mask_of(Condition::Op op) noexcept {
+    switch (op) {
+    case Condition::Op::equals:
+    case Condition::Op::in:
+      return equal_bit;
+    case Condition::Op::not_equals:
+    case Condition::Op::not_in:
+      return equal_bit | negate_bit;
+    case Condition::Op::less:
+      return less_bit;
+    case Condition::Op::less_equal:
+      return less_bit | equal_bit;
+    case Condition::Op::greater:
+      return greater_bit;
+    case Condition::Op::greater_equal:
+      return greater_bit | equal_bit;
+    }
+    return 0;
+  }
+
+  std::uint8_t compare(const Attribute& attribute,
+                       const Operand& operand) const noexcept {
+    int order;
+    if (attribute.kind == Attribute::Kind::number) {
+      order = (attribute.number > operand.number) -
+              (attribute.number < operand.number);
+    } else {
+      order = attribute.text.compare(
+          std::string_view(text_.data() + operand.offset, operand.size));
+    }
+    std::uint8_t outcome = order < 0 ? less_bit : order > 0 ? greater_bit : equal_bit;
+    return attribute.kind == operand.kind ? outcome : 0;
+  }
+
+  bool holds(const Instruction& instruction,
+             const EvaluationContext& context) const noexcept {
+    const Attribute* attribute = context.find(instruction.attribute);
+    if (!attribute) {
+      return false;
+    }
+    std::uint8_t seen = 0;
+    const Operand* operand = operands_.data() + instruction.first;
+    for (std::uint32_t i = 0; i < instruction.count; ++i) {
+      seen |= compare(*attribute, operand[i]);
+    }
+    bool matched = (seen & instruction.mask) != 0;
+    return matched != ((instruction.mask & negate_bit) != 0);
+  }
+
+public:
+  /**
+   * @brief Compile rules
+   * @param rules The rules, in priority order
+   */
+  explicit RuleSet(std::vector<Rule> rules) {
+    for (auto& rule : rules) {
+      for (const auto& condition : rule.conditions) {
+        Instruction instruction{detail::hash_bytes(condition.attribute),
+                                static_cast<std::uint32_t>(operands_.size()),
+                                static_cast<std::uint32_t>(condition.operands.size()),
+                                mask_of(condition.op)};
+        for (const auto& operand : condition.operands) {
+          operands_.push_back({operand.number,
+                               static_cast<std::uint32_t>(text_.size()),
+                               static_cast<std::uint32_t>(operand.text.size()),
+                               operand.kind});
+          text_ += operand.text;
+        }
+        program_.push_back(instruction);
+      }
+      ends_.push_back(static_cast<std::uint32_t>(program_.size()));
+      values_.push_back(std::move(rule.value));
+    }
+  }
+
+  /**
+   * @brief Find the first rule a context satisfies
+   * @param context The evaluation context
+   * @return std::size_t The rule's index, or npos if none matches
+   */
+  std::size_t match(const EvaluationContext& context) const noexcept {
+    std::uint32_t pc = 0;
+    for (std::size_t rule = 0; rule < ends_.size(); ++rule) {
+      bool all = true;
+      for (; pc < ends_[rule]; ++pc) {
+        all &= holds(program_[pc], context);
+      }
+      if (all) {
+        return rule;
+      }
+    }
+    return npos;
+  }
+
+  /**
+   * @brief Get a rule's value
+   * @param index An index returned by match()
+   * @return const FlagValue& The rule's value
+   */
+  const FlagValue& value(std::size_t index) const { return values_[index]; }
+
+  std::size_t size() const noexcept { return values_.size(); }
+};
+
+/**
+ * @brief Reference-counted, immutable view of a string flag value
+ *
+ * Keeps the snapshot it was read from alive, so the view stays valid even
+ * if the flag is updated concurrently. Obtaining and copying one costs an
+ * atomic increment and never allocates.
+ */
+class StringRef {
+private:
+  const detail::ValueNode* node_ = nullptr;
+  std::string_view view_;
+
+  friend class Flag;
+
+  StringRef(const detail::ValueNode* node, std::string_view view) noexcept
+      : node_(node), view_(view) {}
+
+public:
+  /**
+   * @brief Construct an empty reference
+   */
+  StringRef() = default;
+
+  StringRef(const StringRef& other) noexcept
+      : node_(other.node_), view_(other.view_) {
+    if (node_) {
+      node_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  StringRef(StringRef&& other) noexcept
+      : node_(std::exchange(other.node_, nullptr)),
+        view_(std::exchange(other.view_, {})) {}
+
+  StringRef& operator=(StringRef other) noexcept {
+    std::swap(node_, other.node_);
+    std::swap(view_, other.view_);
+    return *this;
+  }
+
+  ~StringRef() {
+    if (node_) {
+      node_->release();
+    }
+  }
+
+  /**
+   * @brief Check whether the flag held a string when this was read
+   */
+  explicit operator bool() const noexcept { return node_ != nullptr; }
+
+  /**
+   * @brief Get the referenced string
+   * @return std::string_view The string, or an empty view for an empty reference
+   */
+  std::string_view view() const noexcept { return view_; }
+  operator std::string_view() const noexcept { return view_; }
+
+  const char* data() const noexcept { return view_.data(); }
+  std::size_t size() const noexcept { return view_.size(); }
+  bool empty() const noexcept { return view_.empty(); }
+};
+
+class Flag;
+
+namespace detail {
+
+#if defined(__linux__)
+
+/**
+ * @brief Sleep while a 32-bit word holds a value, or until the timeout
+ */
+inline void wait_on(const std::atomic<std::uint32_t>& word, std::uint32_t value,
+                    std::chrono::nanoseconds timeout) {
+  static_assert(sizeof(word) == sizeof(std::uint32_t),
+                "futex words must be plain 32-bit integers");
+  timespec relative{static_cast<time_t>(timeout.count() / 1000000000),
+                    static_cast<long>(timeout.count() % 1000000000)};
+  ::syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, value, &relative, nullptr, 0);
+}
+
+/**
+ * @brief Wake every thread sleeping in wait_on() for a word
+ */
+inline void wake_all(const std::atomic<std::uint32_t>& word) {
+  ::syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+// Without futexes, every waiter shares one condition variable
+struct ChangeSignal {
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  static ChangeSignal& instance() {
+    static ChangeSignal* signal = new ChangeSignal();
+    return *signal;
+  }
+};
+
+inline void wait_on(const std::atomic<std::uint32_t>& word, std::uint32_t value,
+                    std::chrono::nanoseconds timeout) {
+  ChangeSignal& signal = ChangeSignal::instance();
+  std::unique_lock lock(signal.mutex);
+  signal.changed.wait_for(lock, timeout, [&] {
+    return word.load(std::memory_order_acquire) != value;
+  });
+}
+
+inline void wake_all(const std::atomic<std::uint32_t>&) {
+  ChangeSignal& signal = ChangeSignal::instance();
+  { std::lock_guard lock(signal.mutex); }
+  signal.changed.notify_all();
+}
+
+#endif
+
+/**
+ * @brief Intrusive node for a coroutine waiting on a flag change
+ *
+ * Lives inside the waiting coroutine's frame; the flag links nodes into a
+ * lock-free stack and never allocates for them.
+ */
+struct ChangeWaiter {
+  ChangeWaiter* next = nullptr;
+  std::uint32_t version = 0; // The change count the waiter started from
+  void (*resume)(ChangeWaiter*) = nullptr;
+};
+
+/**
+ * @brief A flag's change callbacks and its notification state
+ */
+struct Subscribers {
+  using Callback = std::function<void(const Flag&, const Value&)>;
+
+  std::mutex list_mutex; // Guards callbacks and next_id
+  std::vector<std::pair<std::uint64_t, std::shared_ptr<const Callback>>> callbacks;
+  std::uint64_t next_id = 1;
+
+  std::mutex dispatch_mutex; // Held while callbacks run; guards flag
+  const Flag* flag = nullptr;
+
+  std::atomic<bool> pending{false}; // Queued and not yet dispatched
+
+  void dispatch();
+};
+
+/**
+ * @brief Process-wide thread that runs change callbacks
+ *
+ * Writers only mark a flag pending and, if it was not already, queue it.
+ * However many updates land before the notifier gets to a flag, its
+ * callbacks run once with the value current at that time.
+ */
+class Notifier {
+private:
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<std::shared_ptr<Subscribers>> queue_;
+  std::thread thread_;
+
+  Notifier() : thread_([this] { run(); }) {}
+
+  void run() {
+    std::vector<std::shared_ptr<Subscribers>> batch;
+    for (;;) {
+      {
+        std::unique_lock lock(mutex_);
+        wake_.wait(lock, [this] { return !queue_.empty(); });
+        batch.swap(queue_);
+      }
+      for (auto& subscribers : batch) {
+        subscribers->dispatch();
+      }
+      batch.clear();
+    }
+  }
+
+public:
+  Notifier(const Notifier&) = delete;
+  Notifier& operator=(const Notifier&) = delete;
+
+  /**
+   * @brief Get the process-wide notifier
+   *
+   * Leaked, with its thread never joined, so updates made during static
+   * destruction stay safe.
+   */
+  static Notifier& instance() {
+    static Notifier* notifier = new Notifier();
+    return *notifier;
+  }
+
+  /**
+   * @brief Queue a flag's callbacks unless they already are
+   * @param subscribers The flag's subscribers
+   */
+  void schedule(const std::shared_ptr<Subscribers>& subscribers) {
+    if (subscribers->pending.exchange(true, std::memory_order_seq_cst)) {
+      return; // Coalesced into the dispatch already queued
+    }
+    {
+      std::lock_guard lock(mutex_);
+      queue_.push_back(subscribers);
+    }
+    wake_.notify_one();
+  }
+};
+
+} // namespace detail
+
+/**
+ * @brief Which part of a flag produced an evaluated value
+ */
+enum class ExposureSource : std::uint8_t {
+  value,   // The flag's own value
+  rollout, // A rollout variant
+  rule,    // A targeting rule
+};
+
+namespace detail {
+
+/**
+ * @brief Receives keyed evaluations of the flags it is attached to
+ *
+ * Called on the evaluating thread inside an EpochDomain guard, so an
+ * implementation must be cheap and must retire itself through the epoch
+ * domain once detached.
+ */
+class ExposureSink {
+public:
+  /**
+   * @brief Record one evaluation for a string key
+   * @param flag The evaluated flag
+   * @param key The key
+   * @param source Which part of the flag produced the value
+   * @param index The rule or variant index, or npos for the flag's own value
+   */
+  virtual void record(const Flag& flag, std::string_view key, ExposureSource source,
+                      std::size_t index) noexcept = 0;
+
+  /**
+   * @brief Record one evaluation for a numeric key
+   * @param flag The evaluated flag
+   * @param key The key
+   * @param source Which part of the flag produced the value
+   * @param index The rule or variant index, or npos for the flag's own value
+   */
+  virtual void record(const Flag& flag, std::uint64_t key, ExposureSource source,
+                      std::size_t index) noexcept = 0;
+
+protected:
+  ~ExposureSink() = default;
+};
+
+} // namespace detail
+
+/**
+ * @brief Keeps a change callback registered; unsubscribes when destroyed
+ */
+class [[nodiscard]] Subscription {
+private:
+  std::weak_ptr<detail::Subscribers> subscribers_;
+  std::uint64_t id_ = 0;
+
+  friend class Flag;
+
+  Subscription(std::weak_ptr<detail::Subscribers> subscribers, std::uint64_t id)
+      : subscribers_(std::move(subscribers)), id_(id) {}
+
+public:
+  /**
+   * @brief Construct an empty subscription
+   */
+  Subscription() = default;
+
+  Subscription(Subscription&& other) noexcept
+      : subscribers_(std::move(other.subscribers_)),
+        id_(std::exchange(other.id_, 0)) {}
+
+  Subscription& operator=(Subscription&& other) noexcept {
+    if (this != &other) {
+      reset();
+      subscribers_ = std::move(other.subscribers_);
+      id_ = std::exchange(other.id_, 0);
+    }
+    return *this;
+  }
+
+  Subscription(const Subscription&) = delete;
+  Subscription& operator=(const Subscription&) = delete;
+
+  ~Subscription() { reset(); }
+
+  /**
+   * @brief Unsubscribe
+   *
+   * A dispatch that already started may still run the callback once.
+   */
+  void reset() {
+    if (auto subscribers = subscribers_.lock()) {
+      std::lock_guard lock(subscribers->list_mutex);
+      auto& callbacks = subscribers->callbacks;
+      callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(),
+                                     [this](const auto& entry) {
+                                       return entry.first == id_;
+                                     }),
+                      callbacks.end());
+    }
+    subscribers_.reset();
+    id_ = 0;
+  }
+
+  /**
+   * @brief Check whether the subscription is active
+   */
+  explicit operator bool() const noexcept { return id_ != 0; }
+};
+
+/**
+ * @brief Represents a feature flag with thread-safe access
+ * 
+ * Stores the flag's name, value, and description. The value is published
+ * as an immutable snapshot through an atomic pointer: readers never take
+ * a lock, and writers swap in a new snapshot and retire the old one
+ * through the epoch-based reclamation domain. Bool, int and double values
+ * are also kept in a detail::HotValue at the head of the Flag, and copied
+ * to a slot in a dense table shared by all flags, so typed handles can
+ * read them without touching the Flag at all.
+ */
+class Flag {
+private:
+  detail::HotValue hot_; // First, so scalar reads touch one line of the Flag
+  // A copy of hot_ in the process-wide ValueTable, read by TypedFlag
+  detail::HotValue* const slot_ = detail::ValueTable::instance().acquire();
+  std::string storage_; // Name then description, unless both are borrowed
+  std::string_view name_;
+  std::string_view description_;
+  std::atomic<const detail::ValueNode*> value_;
+  std::atomic<const Rollout*> rollout_{nullptr};
+  std::atomic<const RuleSet*> rules_{nullptr};
+  std::shared_ptr<detail::Subscribers> subscribers_; // Set once, then immutable
+  std::atomic<bool> watched_{false};                  // True once subscribers_ is set
+  std::atomic<std::uint32_t> changes_{0};             // Bumped by every commit
+  mutable std::atomic<std::uint32_t> sleepers_{0};    // Threads in wait_for_change
+  mutable std::atomic<detail::ChangeWaiter*> waiters_{nullptr}; // Suspended coroutines
+  std::atomic<detail::ExposureSink*> exposure_{nullptr};
+  std::mutex write_mutex_; // Serialises writes of values, rollouts, rules, subscribers
+
+public:
+  /**
+   * @brief Construct a new Flag object
+   * @param name The flag's name
+   * @param default_value The flag's default value
+   * @param description The flag's description (optional)
+   */
+  Flag(std::string name, FlagValue default_value, std::string description = "")
+      : storage_(std::move(name)),
+        value_(new detail::ValueNode(std::move(default_value))) {
+    std::size_t name_size = storage_.size();
+    storage_ += description;
+    name_ = std::string_view(storage_).substr(0, name_size);
+    description_ = std::string_view(storage_).substr(name_size);
+    publish_scalar(value_.load(std::memory_order_relaxed)->value);
+  }
+
+  /**
+   * @brief Tag selecting the constructor that views its strings
+   */
+  struct Borrowed {};
+
+  /**
+   * @brief Construct a Flag that views its name and description
+   *
+   * Nothing is copied; the caller keeps both strings alive and unchanged
+   * for the flag's lifetime. Used to serve flags from a mapped snapshot
+   * and to keep names in a registry's arena.
+   *
+   * @param name The flag's name
+   * @param default_value The flag's default value
+   * @param description The flag's description
+   */
+  Flag(Borrowed, std::string_view name, FlagValue default_value,
+       std::string_view description)
+      : name_(name), description_(description),
+        value_(new detail::ValueNode(std::move(default_value))) {
+    publish_scalar(value_.load(std::memory_order_relaxed)->value);
+  }
+
+  Flag(const Flag&) = delete;
+  Flag& operator=(const Flag&) = delete;
+
+  ~Flag() {
+    if (subscribers_) {
+      std::lock_guard lock(subscribers_->dispatch_mutex);
+      subscribers_->flag = nullptr;
+    }
+    // No reader can be inside this flag any more, so only outstanding
+    // StringRefs can still need its nodes
+    const detail::ValueNode* node = value_.load(std::memory_order_relaxed);
+    while (node) {
+      const detail::ValueNode* prev = node->prev.load(std::memory_order_relaxed);
+      if (node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete node;
+      }
+      node = prev;
+    }
+    delete rollout_.load(std::memory_order_relaxed);
+    delete rules_.load(std::memory_order_relaxed);
+    detail::ValueTable::instance().release(slot_);
+  }
+
+  /**
+   * @brief Start counting evaluations of this flag
+   *
+   * Reads through value(), scalar(), string_ref(), evaluate() and the
+   * cached and snapshot paths are counted per thread; see
+   * FlagRegistry::evaluation_counts(). Counting cannot be turned off.
+   *
+   * @return bool False if the process has run out of counter ids
+   */
+  bool enable_counting() {
+    std::lock_guard lock(write_mutex_);
+    if (hot_.counter.load(std::memory_order_relaxed) == 0) {
+      std::uint32_t id = detail::EvaluationCounters::instance().allocate();
+      hot_.counter.store(id, std::memory_order_relaxed);
+      slot_->counter.store(id, std::memory_order_relaxed);
+    }
+    return hot_.counter.load(std::memory_order_relaxed) != 0;
+  }
+
+  /**
+   * @brief Check whether evaluations of this flag are counted
+   */
+  bool is_counting() const noexcept {
+    return hot_.counter.load(std::memory_order_relaxed) != 0;
+  }
+
+  /**
+   * @brief Count evaluations, if counting is enabled
+   *
+   * Called by every read path; callers that serve the flag's value from
+   * their own cache call it to keep the count accurate.
+   *
+   * @param count Number of evaluations
+   */
+  void record_evaluation(std::uint64_t count = 1) const noexcept {
+    if (std::uint32_t id = hot_.counter.load(std::memory_order_relaxed)) {
+      detail::EvaluationCounters::instance().increment(id, count);
+    }
+  }
+
+  /**
+   * @brief Sum the evaluation counts of every thread
+   * @return std::uint64_t Evaluations since counting was enabled, or 0
+   */
+  std::uint64_t evaluation_count() const {
+    std::uint32_t id = hot_.counter.load(std::memory_order_relaxed);
+    return id ? detail::EvaluationCounters::instance().total(id) : 0;
+  }
+
+  /**
+   * @brief Get the flag's counter id
+   * @return std::uint32_t The id, or 0 if evaluations are not counted
+   */
+  std::uint32_t counter_id() const noexcept {
+    return hot_.counter.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the flag's name
+   * @return std::string_view The flag's name
+   */
+  std::string_view name() const { return name_; }
+
+  /**
+   * @brief Get the flag's description
+   * @return std::string_view The flag's description
+   */
+  std::string_view description() const { return description_; }
+
+  /**
+   * @brief Get the flag's current value
+   *
+   * Bool, int and double values are read from the flag's sequence-counted
+   * copy, so only string values enter the epoch domain.
+   *
+   * @return Value The flag's value wrapped in a Value object
+   */
+  Value value() const { 
+    record_evaluation();
+    FlagValue scalar;
+    if (hot_.scalar.load(scalar)) {
+      return Value(std::move(scalar));
+    }
+    detail::EpochDomain::Guard guard;
+    return Value(snapshot());
+  }
+
+  /**
+   * @brief Access the current snapshot in place
+   *
+   * The caller must hold a detail::EpochDomain::Guard for as long as it
+   * uses the returned reference.
+   *
+   * @return const FlagValue& The current value
+   */
+  const FlagValue& snapshot() const {
+    return value_.load(std::memory_order_seq_cst)->value;
+  }
+
+  /**
+   * @brief Read a string value without copying it
+   * @return StringRef A reference to the current string, or an empty
+   *         reference if the flag does not hold a string
+   */
+  StringRef string_ref() const {
+    record_evaluation();
+    detail::EpochDomain::Guard guard;
+    for (;;) {
+      const detail::ValueNode* node = value_.load(std::memory_order_seq_cst);
+      const auto* str = std::get_if<std::string>(&node->value);
+      if (!str) {
+        return StringRef();
+      }
+      if (node->try_acquire()) {
+        return StringRef(node, *str);
+      }
+      // The node was replaced and released meanwhile; read the new one
+    }
+  }
+
+  /**
+   * @brief Read a scalar value without entering the epoch domain
+   *
+   * Retries only if it overlaps an update of this flag.
+   *
+   * @tparam T bool, int or double
+   * @return T The current value, or the type's default if the flag holds another type
+   */
+  template <typename T>
+  T scalar() const noexcept {
+    static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> ||
+                      std::is_same_v<T, double>,
+                  "scalar() supports bool, int and double");
+    return hot_.read<T>();
+  }
+
+  /**
+   * @brief Update the flag's value
+   * @tparam T The type of the new value (must be compatible with FlagValue)
+   * @param new_value The new value to set
+   */
+  template <typename T>
+  void update(T new_value) {
+    std::pair<Flag*, detail::ValueNode*> write{
+        this, new detail::ValueNode(FlagValue(std::move(new_value)))};
+    commit(&write, 1);
+  }
+
+  /**
+   * @brief Call a function after the flag's value changes
+   *
+   * Callbacks run on the notifier thread, never inside update(). Updates
+   * that arrive while a notification is still queued are coalesced: the
+   * callback runs once and sees the latest value. Callbacks must not
+   * throw and must not destroy the flag.
+   *
+   * @param callback Receives the flag and its value at dispatch time
+   * @return Subscription Keeps the callback registered while alive
+   */
+  Subscription subscribe(detail::Subscribers::Callback callback) {
+    std::shared_ptr<detail::Subscribers> subscribers;
+    {
+      std::lock_guard lock(write_mutex_);
+      if (!subscribers_) {
+        subscribers_ = std::make_shared<detail::Subscribers>();
+        subscribers_->flag = this;
+        watched_.store(true, std::memory_order_release);
+      }
+      subscribers = subscribers_;
+    }
+    std::lock_guard lock(subscribers->list_mutex);
+    std::uint64_t id = subscribers->next_id++;
+    subscribers->callbacks.emplace_back(
+        id, std::make_shared<const detail::Subscribers::Callback>(std::move(callback)));
+    return Subscription(subscribers, id);
+  }
+
+#ifdef FLAGPP_HAS_COROUTINES
+  /**
+   * @brief Resumes a coroutine on the calling thread
+   */
+  struct InlineExecutor {
+    void operator()(std::coroutine_handle<> handle) const { handle.resume(); }
+  };
+
+  /**
+   * @brief Awaitable that completes on the flag's next change
+   * @tparam Executor Callable taking the std::coroutine_handle<> to resume
+   */
+  template <typename Executor>
+  class ChangeAwaiter : private detail::ChangeWaiter {
+  private:
+    const Flag* flag_;
+    Executor executor_;
+    std::coroutine_handle<> handle_;
+
+    static void resume_on_executor(detail::ChangeWaiter* node) {
+      auto* self = static_cast<ChangeAwaiter*>(node);
+      // The coroutine may finish, and free this awaiter, inside the call
+      Executor executor = self->executor_;
+      executor(self->handle_);
+    }
+
+  public:
+    ChangeAwaiter(const Flag& flag, Executor executor)
+        : flag_(&flag), executor_(std::move(executor)) {
+      version = flag.change_version();
+      resume = &resume_on_executor;
+    }
+
+    bool await_ready() const noexcept { return flag_->change_version() != version; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+      flag_->push_waiter(this);
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  /**
+   * @brief Wait, without blocking a thread, for the flag's next change
+   *
+   * `co_await flag.changed(executor)` suspends until a value committed
+   * after this call, then hands the coroutine to the executor. Waiting
+   * costs the awaiter's few words inside the coroutine frame.
+   *
+   * @param executor Callable taking the std::coroutine_handle<> to resume;
+   *        by default the coroutine resumes on the committing thread
+   * @return ChangeAwaiter<Executor> The awaitable
+   */
+  template <typename Executor = InlineExecutor>
+  ChangeAwaiter<Executor> changed(Executor executor = Executor()) const {
+    return ChangeAwaiter<Executor>(*this, std::move(executor));
+  }
+#endif
+
+  /**
+   * @brief Get the flag's change counter
+   *
+   * Incremented every time a new value is committed. Pass it to
+   * wait_for_change() to sleep until the next change.
+   *
+   * @return std::uint32_t The current count; wraps around
+   */
+  std::uint32_t change_version() const noexcept {
+    return changes_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Sleep until the flag changes past a version or a timeout expires
+   *
+   * Uses a futex on Linux, so waiting consumes no CPU and a commit wakes
+   * the waiter directly.
+   *
+   * @param version A value previously returned by change_version()
+   * @param timeout The longest time to wait
+   * @return bool True if the flag changed, false on timeout
+   */
+  bool wait_for_change(std::uint32_t version, std::chrono::nanoseconds timeout) const {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (changes_.load(std::memory_order_acquire) == version) {
+      auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining <= std::chrono::nanoseconds::zero()) {
+        return false;
+      }
+      sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      if (changes_.load(std::memory_order_seq_cst) == version) {
+        detail::wait_on(changes_, version,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+      }
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read the value as of a committed version
+   * @param version A version pinned by a Snapshot
+   * @return Value The value the flag had at that version
+   */
+  Value value_at(std::uint64_t version) const {
+    detail::EpochDomain::Guard guard;
+    return Value(snapshot_at(version));
+  }
+
+  /**
+   * @brief Access the value as of a committed version in place
+   *
+   * The caller must hold a detail::EpochDomain::Guard for as long as it
+   * uses the returned reference, and the version must stay pinned.
+   */
+  const FlagValue& snapshot_at(std::uint64_t version) const {
+    const detail::ValueNode* node = value_.load(std::memory_order_seq_cst);
+    while (node->version > version) {
+      node = node->prev.load(std::memory_order_acquire);
+    }
+    return node->value;
+  }
+
+  /**
+   * @brief Attach or replace the flag's rollout
+   * @param rollout The rollout to evaluate keys against
+   */
+  void set_rollout(Rollout rollout) {
+    swap_published(rollout_, new Rollout(std::move(rollout)));
+  }
+
+  /**
+   * @brief Detach the flag's rollout so every key gets the flag's value
+   */
+  void clear_rollout() { swap_published<Rollout>(rollout_, nullptr); }
+
+  /**
+   * @brief Compile and attach targeting rules, replacing any previous ones
+   *
+   * Rules are only consulted when evaluating an EvaluationContext, and take
+   * precedence over the rollout.
+   *
+   * @param rules The rules, in priority order
+   */
+  void set_rules(std::vector<Rule> rules) {
+    swap_published(rules_, new RuleSet(std::move(rules)));
+  }
+
+  /**
+   * @brief Detach the flag's targeting rules
+   */
+  void clear_rules() { swap_published<RuleSet>(rules_, nullptr); }
+
+  /**
+   * @brief Check whether targeting rules are attached
+   */
+  bool has_rules() const noexcept {
+    return rules_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  /**
+   * @brief Check whether a rollout is attached
+   */
+  bool has_rollout() const noexcept {
+    return rollout_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  /**
+   * @brief Evaluate the flag for a per-request key
+   * @tparam Key std::string_view, std::uint64_t or EvaluationContext
+   * @param key The per-request key
+   * @return Value The value of the first matching rule (contexts only),
+   *         else the variant selected by the rollout, else the flag's value
+   */
+  template <typename Key>
+  Value evaluate(const Key& key) const {
+    detail::EpochDomain::Guard guard;
+    return Value(evaluate_in_guard(key));
+  }
+
+  /**
+   * @brief Check whether the flag is on for a per-request key
+   * @tparam Key std::string_view or std::uint64_t
+   * @param key The per-request key
+   * @return bool True if the selected value is the boolean true
+   */
+  template <typename Key>
+  bool is_enabled_for(const Key& key) const {
+    detail::EpochDomain::Guard guard;
+    const bool* enabled = std::get_if<bool>(&evaluate_in_guard(key));
+    return enabled && *enabled;
+  }
+
+  /**
+   * @brief Access the attached rollout in place
+   *
+   * The caller must hold a detail::EpochDomain::Guard for as long as it
+   * uses the returned pointer.
+   *
+   * @return const Rollout* The rollout, or nullptr if none is attached
+   */
+  const Rollout* rollout_in_guard() const noexcept {
+    return rollout_.load(std::memory_order_seq_cst);
+  }
+
+  /**
+   * @brief Evaluate the flag in place
+   *
+   * The caller must hold a detail::EpochDomain::Guard for as long as it
+   * uses the returned reference.
+   */
+  template <typename Key>
+  const FlagValue& evaluate_in_guard(const Key& key) const {
+    record_evaluation();
+    if constexpr (std::is_same_v<Key, EvaluationContext>) {
+      if (const RuleSet* rules = rules_.load(std::memory_order_seq_cst)) {
+        std::size_t index = rules->match(key);
+        if (index != RuleSet::npos) {
+          expose(key, ExposureSource::rule, index);
+          return rules->value(index);
+        }
+      }
+    }
+    if (const Rollout* rollout = rollout_.load(std::memory_order_seq_cst)) {
+      std::size_t index = rollout->variant(key);
+      if (index != Rollout::npos) {
+        expose(key, ExposureSource::rollout, index);
+        return rollout->value(index);
+      }
+    }
+    expose(key, ExposureSource::value, Rollout::npos);
+    return snapshot();
+  }
+
+  /**
+   * @brief Attach or detach the sink that keyed evaluations are reported to
+   *
+   * A sink that is replaced may still be called by evaluations already in
+   * progress; it must stay alive until the epoch domain says otherwise.
+   *
+   * @param sink The sink, or nullptr to stop reporting
+   * @return detail::ExposureSink* The sink that was attached before
+   */
+  detail::ExposureSink* set_exposure_sink(detail::ExposureSink* sink) noexcept {
+    return exposure_.exchange(sink, std::memory_order_acq_rel);
+  }
+
+  /**
+   * @brief Replace the exposure sink only if it is still the expected one
+   * @param expected The sink thought to be attached; receives the one that
+   *        was attached if it was not
+   * @param sink The sink, or nullptr to stop reporting
+   * @return bool True if the sink was replaced
+   */
+  bool exchange_exposure_sink(detail::ExposureSink*& expected,
+                              detail::ExposureSink* sink) noexcept {
+    return exposure_.compare_exchange_strong(expected, sink, std::memory_order_acq_rel,
+                                             std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Get the attached exposure sink
+   * @return detail::ExposureSink* The sink, or nullptr if none is attached
+   */
+  detail::ExposureSink* exposure_sink() const noexcept {
+    return exposure_.load(std::memory_order_acquire);
+  }
+
+private:
+  friend class Transaction;
+  template <typename>
+  friend class TypedFlag;
+
+  void publish_scalar(const FlagValue& value) noexcept {
+    slot_->scalar.store(value);
+    hot_.scalar.store(value);
+  }
+
+  // Links a new value in front of the current one; needs write_mutex_
+  void link(detail::ValueNode* next, std::uint64_t version) {
+    next->version = version;
+    next->prev.store(value_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    publish_scalar(next->value);
+    value_.store(next, std::memory_order_seq_cst);
+  }
+
+  // Publishes one flag's value without the commit mutex, if no snapshot
+  // is pinned and no transaction has an uncommitted value on the flag
+  bool commit_single(detail::ValueNode* next) {
+    detail::VersionClock& clock = detail::VersionClock::instance();
+    if (!clock.enter_single()) {
+      return false;
+    }
+    bool done = false;
+    {
+      std::lock_guard lock(write_mutex_);
+      // Stamped with the last committed version, so every later pin sees it
+      std::uint64_t version = clock.committed.load(std::memory_order_acquire);
+      if (value_.load(std::memory_order_relaxed)->version <= version) {
+        link(next, version);
+        trim(version); // Nothing pinned, so no older value is needed
+        done = true;
+      }
+    }
+    clock.leave_single();
+    return done;
+  }
+
+  // Publishes new values for one or more flags at a single version. Each
+  // superseded value stays linked behind its replacement until no pinned
+  // snapshot can read it. Only transactions and writes made while a
+  // snapshot is pinned take the global commit mutex.
+  static void commit(std::pair<Flag*, detail::ValueNode*>* writes,
+                     std::size_t count) {
+    if (count != 1 || !writes[0].first->commit_single(writes[0].second)) {
+      detail::VersionClock& clock = detail::VersionClock::instance();
+      std::lock_guard lock(clock.commit_mutex);
+      std::uint64_t version = clock.committed.load(std::memory_order_relaxed) + 1;
+      for (std::size_t i = 0; i < count; ++i) {
+        std::lock_guard flag_lock(writes[i].first->write_mutex_);
+        writes[i].first->link(writes[i].second, version);
+      }
+      clock.committed.store(version, std::memory_order_seq_cst);
+
+      std::uint64_t oldest = clock.oldest_pinned(version);
+      for (std::size_t i = 0; i < count; ++i) {
+        std::lock_guard flag_lock(writes[i].first->write_mutex_);
+        writes[i].first->trim(oldest);
+      }
+    }
+    detail::generation.fetch_add(1, std::memory_order_release);
+    for (std::size_t i = 0; i < count; ++i) {
+      Flag* flag = writes[i].first;
+      flag->changes_.fetch_add(1, std::memory_order_seq_cst);
+      if (flag->sleepers_.load(std::memory_order_seq_cst) != 0) {
+        detail::wake_all(flag->changes_);
+      }
+      if (flag->waiters_.load(std::memory_order_seq_cst)) {
+        flag->drain_waiters();
+      }
+      if (flag->watched_.load(std::memory_order_acquire)) {
+        detail::Notifier::instance().schedule(flag->subscribers_);
+      }
+    }
+  }
+
+  template <typename Key>
+  void expose(const Key& key, ExposureSource source, std::size_t index) const {
+    // The sink is retired through the epoch domain, so load it like the
+    // other pointers read under a guard
+    detail::ExposureSink* sink = exposure_.load(std::memory_order_seq_cst);
+    if (!sink) {
+      return;
+    }
+    if constexpr (std::is_same_v<Key, EvaluationContext>) {
+      sink->record(*this, key.key, source, index);
+    } else if constexpr (std::is_convertible_v<const Key&, std::string_view>) {
+      sink->record(*this, std::string_view(key), source, index);
+    } else {
+      sink->record(*this, static_cast<std::uint64_t>(key), source, index);
+    }
+  }
+
+  // Links a suspended coroutine into the waiter stack. A change that was
+  // committed before the push could have missed it, so check and drain.
+  void push_waiter(detail::ChangeWaiter* waiter) const {
+    // Once linked, a concurrent drain may resume and free the waiter
+    const std::uint32_t version = waiter->version;
+    detail::ChangeWaiter* head = waiters_.load(std::memory_order_relaxed);
+    do {
+      waiter->next = head;
+    } while (!waiters_.compare_exchange_weak(head, waiter, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed));
+    if (changes_.load(std::memory_order_seq_cst) != version) {
+      drain_waiters();
+    }
+  }
+
+  // Takes the whole stack, resumes waiters that have seen a change and
+  // pushes the rest back. Whoever takes the stack owns those nodes until
+  // it resumes or re-links them, so no waiter is resumed twice.
+  void drain_waiters() const {
+    for (;;) {
+      detail::ChangeWaiter* list = waiters_.exchange(nullptr, std::memory_order_seq_cst);
+      if (!list) {
+        return;
+      }
+      std::uint32_t current = changes_.load(std::memory_order_seq_cst);
+      detail::ChangeWaiter* keep = nullptr;
+      detail::ChangeWaiter* keep_tail = nullptr;
+      while (list) {
+        detail::ChangeWaiter* next = list->next;
+        if (list->version != current) {
+          list->resume(list);
+        } else {
+          list->next = keep;
+          keep = list;
+          keep_tail = keep_tail ? keep_tail : list;
+        }
+        list = next;
+      }
+      if (!keep) {
+        return;
+      }
+      detail::ChangeWaiter* head = waiters_.load(std::memory_order_relaxed);
+      do {
+        keep_tail->next = head;
+      } while (!waiters_.compare_exchange_weak(head, keep, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed));
+      if (changes_.load(std::memory_order_seq_cst) == current) {
+        return; // Any later change will see the re-linked waiters
+      }
+    }
+  }
+
+  // Unlinks and releases every value older than the one visible at the
+  // oldest pinned version. Called with write_mutex_ held.
+  void trim(std::uint64_t oldest) {
+    const detail::ValueNode* node = value_.load(std::memory_order_relaxed);
+    while (node->version > oldest) {
+      node = node->prev.load(std::memory_order_relaxed);
+    }
+    const detail::ValueNode* stale =
+        node->prev.exchange(nullptr, std::memory_order_acq_rel);
+    while (stale) {
+      const detail::ValueNode* prev = stale->prev.load(std::memory_order_relaxed);
+      stale->release();
+      stale = prev;
+    }
+  }
+
+  template <typename T>
+  void swap_published(std::atomic<const T*>& slot, const T* next) {
+    const T* previous;
+    {
+      std::lock_guard lock(write_mutex_);
+      previous = slot.exchange(next, std::memory_order_seq_cst);
+    }
+    detail::generation.fetch_add(1, std::memory_order_release);
+    if (previous) {
+      detail::EpochDomain::instance().retire(previous);
+    }
+  }
+};
+
+inline void detail::Subscribers::dispatch() {
+  // Cleared before the value is read, so a later update queues again
+  pending.store(false, std::memory_order_seq_cst);
+
+  std::lock_guard lock(dispatch_mutex);
+  if (!flag) {
+    return;
+  }
+  std::vector<std::shared_ptr<const Callback>> current;
+  {
+    std::lock_guard list_lock(list_mutex);
+    for (const auto& entry : callbacks) {
+      current.push_back(entry.second);
+    }
+  }
+  if (current.empty()) {
+    return;
+  }
+  Value value = flag->value();
+  for (const auto& callback : current) {
+    (*callback)(*flag, value);
+  }
+}
+
+/**
+ * @brief Typed handle to a registered flag
+ *
+ * Holding a handle skips the name lookup entirely. For bool, int and double
+ * flags load() is a sequence-counted read of plain loads: no hashing, no
+ * locks and no read-modify-writes. The handle also dereferences to the
+ * underlying Flag, so it can be used wherever a std::shared_ptr<Flag> was.
+ *
+ * @tparam T bool, int, double or std::string
+ */
+template <typename T>
+class TypedFlag {
+  static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> ||
+                    std::is_same_v<T, double> || std::is_same_v<T, std::string>,
+                "TypedFlag supports bool, int, double and std::string");
+
+private:
+  std::shared_ptr<Flag> flag_;
+  const detail::HotValue* hot_ = nullptr; // The flag's ValueTable slot
+
+public:
+  using value_type = T;
+
+  /**
+   * @brief Construct an empty handle
+   */
+  TypedFlag() = default;
+
+  /**
+   * @brief Construct a handle to an existing flag
+   * @param flag The flag to wrap
+   */
+  explicit TypedFlag(std::shared_ptr<Flag> flag)
+      : flag_(std::move(flag)), hot_(flag_ ? flag_->slot_ : nullptr) {}
+
+  /**
+   * @brief Read the flag's current value
+   * @return T The value, or the type's default if the flag holds another type
+   */
+  T load() const {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return static_cast<std::string>(flag_->value());
+    } else {
+      return hot_->read<T>();
+    }
+  }
+
+  /**
+   * @brief Read a string flag without copying it
+   * @return StringRef Reference to the current string
+   */
+  template <typename U = T,
+            typename = std::enable_if_t<std::is_same_v<U, std::string>>>
+  StringRef load_ref() const {
+    return flag_->string_ref();
+  }
+
+  /**
+   * @brief Update the flag's value
+   * @param value The new value to set
+   */
+  void update(T value) const { flag_->update(std::move(value)); }
+
+  /**
+   * @brief Get the underlying flag
+   * @return const std::shared_ptr<Flag>& The flag, or nullptr for an empty handle
+   */
+  const std::shared_ptr<Flag>& flag() const noexcept { return flag_; }
+
+  operator std::shared_ptr<Flag>() const { return flag_; }
+
+  Flag* operator->() const noexcept { return flag_.get(); }
+  Flag& operator*() const noexcept { return *flag_; }
+
+  friend bool operator==(const TypedFlag& handle, std::nullptr_t) noexcept {
+    return handle.flag_ == nullptr;
+  }
+  friend bool operator!=(const TypedFlag& handle, std::nullptr_t) noexcept {
+    return handle.flag_ != nullptr;
+  }
+};
+
+using BoolFlag = TypedFlag<bool>;
+using IntFlag = TypedFlag<int>;
+using DoubleFlag = TypedFlag<double>;
+using StringFlag = TypedFlag<std::string>;
+
+/**
+ * @brief Handle to a flag evaluated per request through a Rollout
+ */
+class RolloutFlag {
+private:
+  std::shared_ptr<Flag> flag_;
+
+public:
+  /**
+   * @brief Construct an empty handle
+   */
+  RolloutFlag() = default;
+
+  /**
+   * @brief Construct a handle to an existing flag
+   * @param flag The flag to wrap
+   */
+  explicit RolloutFlag(std::shared_ptr<Flag> flag) : flag_(std::move(flag)) {}
+
+  /**
+   * @brief Check whether the flag is on for a key
+   * @tparam Key std::string_view or std::uint64_t
+   * @param key The per-request key
+   * @return bool True if the selected value is the boolean true
+   */
+  template <typename Key>
+  bool is_enabled(const Key& key) const {
+    return flag_->is_enabled_for(key);
+  }
+
+  /**
+   * @brief Evaluate the flag for a key
+   * @tparam Key std::string_view or std::uint64_t
+   * @param key The per-request key
+   * @return Value The selected value
+   */
+  template <typename Key>
+  Value evaluate(const Key& key) const {
+    return flag_->evaluate(key);
+  }
+
+  /**
+   * @brief Replace the rollout
+   * @param rollout The new rollout
+   */
+  void set_rollout(Rollout rollout) const {
+    flag_->set_rollout(std::move(rollout));
+  }
+
+  const std::shared_ptr<Flag>& flag() const noexcept { return flag_; }
+
+  operator std::shared_ptr<Flag>() const { return flag_; }
+
+  Flag* operator->() const noexcept { return flag_.get(); }
+  Flag& operator*() const noexcept { return *flag_; }
+
+  friend bool operator==(const RolloutFlag& handle, std::nullptr_t) noexcept {
+    return handle.flag_ == nullptr;
+  }
+  friend bool operator!=(const RolloutFlag& handle, std::nullptr_t) noexcept {
+    return handle.flag_ != nullptr;
+  }
+};
+
+/**
+ * @brief Construction options for FlagRegistry
+ */
+struct RegistryOptions {
+  /**
+   * @brief Number of independently locked shards, rounded up to a power of two
+   *
+   * Each shard sits on its own cache line with its own lock and map, so
+   * lookups of different names stop contending on one lock word.
+   */
+  std::size_t shards = 1;
+
+  /**
+   * @brief Count evaluations of every flag the registry defines or inserts
+   *
+   * See Flag::enable_counting() and FlagRegistry::evaluation_counts().
+   */
+  bool count_evaluations = false;
+
+  /**
+   * @brief Allocate defined flags, their names and the map nodes from an arena
+   *
+   * Cuts define() from four heap allocations to one (the flag's initial
+   * value) and keeps the metadata of a large flag set contiguous. The
+   * arena is freed once the registry and every handle to its flags are
+   * gone. Flags added with insert() are allocated by their creator.
+   */
+  bool arena = false;
+};
+
+/**
+ * @brief A set of flags a registry constructs on first lookup
+ *
+ * Lets a registry serve a large, mostly unread flag set, such as a mapped
+ * snapshot, without building every Flag up front. The registry calls
+ * make() with the lock of the name's shard held, so it is never called
+ * twice for one name; both functions must be safe to call concurrently.
+ */
+class FlagSource {
+public:
+  virtual ~FlagSource() = default;
+
+  /**
+   * @brief Construct a flag
+   * @param key The flag's name and hash
+   * @return std::shared_ptr<Flag> The flag, or nullptr if the source does not have it
+   */
+  virtual std::shared_ptr<Flag> make(const detail::HashedName& key) const = 0;
+
+  /**
+   * @brief Call a function with the name of every flag in the source
+   * @param fn Called once per name
+   */
+  virtual void for_each_name(const std::function<void(std::string_view)>& fn) const = 0;
+};
+
+class Snapshot;
+class Transaction;
+
+/**
+ * @brief Singleton registry for all feature flags
+ * 
+ * Provides thread-safe storage and access to all feature flags
+ * in the application. Flags are spread over one or more shards selected
+ * by the name's hash; each shard has its own reader-writer lock.
+ */
+class FlagRegistry {
+private:
+  // Keys view the flag's own name, so lookups by std::string_view or
+  // string literal never build a temporary std::string
+  using Map = std::pmr::unordered_map<detail::HashedName, std::shared_ptr<Flag>,
+                                      detail::HashedNameHash>;
+
+  struct alignas(detail::cache_line_size) Shard {
+    mutable std::shared_mutex mutex;
+    Map flags;
+
+    explicit Shard(std::pmr::memory_resource* resource) : flags(resource) {}
+  };
+
+  // Destroys and frees the shard array built by the constructor
+  struct ShardsDeleter {
+    std::size_t count;
+
+    void operator()(Shard* shards) const {
+      for (std::size_t i = count; i > 0; --i) {
+        shards[i - 1].~Shard();
+      }
+      std::allocator<Shard>().deallocate(shards, count);
+    }
+  };
+
+  /**
+   * @brief Immutable minimal perfect hash table over a fixed flag set
+   *
+   * Hash-and-displace construction: names are split into buckets by their
+   * hash, and each bucket stores a seed that scatters its names onto
+   * otherwise unused slots. There is exactly one slot per flag, held in a
+   * contiguous array; a lookup is one bucket read, one slot read and a
+   * name comparison.
+   */
+  class FrozenTable {
+  private:
+    struct Entry {
+      detail::HashedName key;
+      std::shared_ptr<Flag> flag;
+    };
+
+    std::vector<Entry> slots_;
+    std::vector<std::uint32_t> seeds_;
+
+    static std::size_t reduce(std::uint64_t hash, std::size_t range) {
+      return static_cast<std::size_t>(((hash & 0xffffffffULL) * range) >> 32);
+    }
+
+    std::size_t bucket_of(std::uint64_t hash) const {
+      return reduce(hash, seeds_.size());
+    }
+
+    std::size_t slot_of(std::uint64_t hash, std::uint32_t seed) const {
+      return reduce(detail::mix64(hash + seed * 0x9e3779b97f4a7c15ULL),
+                    slots_.size());
+    }
+
+  public:
+    /**
+     * @brief Build the table
+     * @param entries Every flag to include, keyed by its own name
+     * @return bool False if two names share a 64-bit hash and cannot be separated
+     */
+    bool build(std::vector<std::pair<detail::HashedName, std::shared_ptr<Flag>>> entries) {
+      const std::size_t n = entries.size();
+      if (n == 0) {
+        return true;
+      }
+      seeds_.assign((n + 3) / 4, 0);
+      slots_.assign(n, Entry{detail::HashedName(""), nullptr});
+
+      std::vector<std::vector<std::size_t>> buckets(seeds_.size());
+      for (std::size_t i = 0; i < n; ++i) {
+        buckets[bucket_of(entries[i].first.hash)].push_back(i);
+      }
+      std::vector<std::size_t> order(buckets.size());
+      for (std::size_t b = 0; b < order.size(); ++b) {
+        order[b] = b;
+      }
+      std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return buckets[a].size() > buckets[b].size();
+      });
+
+      std::vector<bool> taken(n, false);
+      std::vector<std::size_t> placed;
+      for (std::size_t b : order) {
+        const auto& members = buckets[b];
+        if (members.empty()) {
+          break;
+        }
+
+        bool ok = false;
+        for (std::uint32_t seed = 0; seed < (1u << 24) && !ok; ++seed) {
+          placed.clear();
+          ok = true;
+          for (std::size_t i : members) {
+            std::size_t slot = slot_of(entries[i].first.hash, seed);
+            if (taken[slot] ||
+                std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+              ok = false;
+              break;
+            }
+            placed.push_back(slot);
+          }
+          if (ok) {
+            seeds_[b] = seed;
+          }
+        }
+        if (!ok) {
+          return false;
+        }
+
+        for (std::size_t k = 0; k < members.size(); ++k) {
+          taken[placed[k]] = true;
+          slots_[placed[k]] = Entry{entries[members[k]].first,
+                                    std::move(entries[members[k]].second)};
+        }
+      }
+      return true;
+    }
+
+    /**
+     * @brief Look up a flag
+     * @param key The flag's name and hash
+     * @return const std::shared_ptr<Flag>* The flag, or nullptr if not in the table
+     */
+    const std::shared_ptr<Flag>* find(const detail::HashedName& key) const {
+      if (slots_.empty()) {
+        return nullptr;
+      }
+      const Entry& entry = slots_[slot_of(key.hash, seeds_[bucket_of(key.hash)])];
+      return entry.key == key ? &entry.flag : nullptr;
+    }
+
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+      for (const auto& entry : slots_) {
+        fn(entry.flag);
+      }
+    }
+
+    std::size_t size() const noexcept { return slots_.size(); }
+  };
+
+  std::shared_ptr<detail::Arena> arena_; // Outlives the shards' maps
+  std::unique_ptr<Shard[], ShardsDeleter> shards_;
+  std::size_t shard_mask_;
+  std::unique_ptr<FrozenTable> frozen_storage_;
+  std::atomic<const FrozenTable*> frozen_{nullptr};
+  bool count_evaluations_ = false;
+  mutable std::shared_mutex sources_mutex_; // Taken after any shard lock
+  std::vector<std::shared_ptr<const FlagSource>> sources_;
+  std::atomic<bool> has_sources_{false};
+
+  Shard& shard_for(const detail::HashedName& key) const {
+    // High bits pick the shard; the map's buckets use the hash modulo
+    // their count, which is dominated by the low bits
+    return shards_[(key.hash >> 32) & shard_mask_];
+  }
+
+  // Adds the flag from the first source that has it; needs the shard's
+  // lock held exclusively and sources_mutex_ held
+  Map::iterator make_from_sources(Shard& shard, const detail::HashedName& key) const {
+    for (const auto& source : sources_) {
+      if (std::shared_ptr<Flag> flag = source->make(key)) {
+        if (count_evaluations_) {
+          flag->enable_counting();
+        }
+        detail::HashedName stored = key;
+        stored.name = flag->name();
+        detail::generation.fetch_add(1, std::memory_order_release);
+        return shard.flags.emplace(stored, std::move(flag)).first;
+      }
+    }
+    return shard.flags.end();
+  }
+
+  // Finds a flag, constructing it from a source if needed; needs the
+  // shard's lock held exclusively
+  Map::iterator find_locked(Shard& shard, const detail::HashedName& key) const {
+    auto it = shard.flags.find(key);
+    if (it != shard.flags.end() || !has_sources_.load(std::memory_order_acquire)) {
+      return it;
+    }
+    std::shared_lock lock(sources_mutex_);
+    return make_from_sources(shard, key);
+  }
+
+  // Constructs every flag the sources have
+  void make_all() const {
+    std::vector<std::shared_ptr<const FlagSource>> sources;
+    {
+      std::shared_lock lock(sources_mutex_);
+      sources = sources_;
+    }
+    for (const auto& source : sources) {
+      source->for_each_name([this](std::string_view name) { get(name); });
+    }
+  }
+
+public:
+  /**
+   * @brief Construct an empty registry
+   * @param options Registry configuration
+   */
+  explicit FlagRegistry(RegistryOptions options = {}) {
+    std::size_t count = 1;
+    while (count < options.shards) {
+      count <<= 1;
+    }
+    if (options.arena) {
+      arena_ = std::make_shared<detail::Arena>();
+    }
+    // A map's allocator is fixed when it is built, so each shard is built
+    // with the arena or the default resource
+    std::pmr::memory_resource* resource =
+        arena_ ? arena_.get() : std::pmr::get_default_resource();
+    Shard* shards = std::allocator<Shard>().allocate(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      new (shards + i) Shard(resource);
+    }
+    shards_ = std::unique_ptr<Shard[], ShardsDeleter>(shards, ShardsDeleter{count});
+    shard_mask_ = count - 1;
+    count_evaluations_ = options.count_evaluations;
+  }
+
+  // Delete copy/move constructors and assignment operators
+  FlagRegistry(const FlagRegistry&) = delete;
+  FlagRegistry& operator=(const FlagRegistry&) = delete;
+  FlagRegistry(FlagRegistry&&) = delete;
+  FlagRegistry& operator=(FlagRegistry&&) = delete;
+
+  /**
+   * @brief Get the singleton instance
+   * @return FlagRegistry& Reference to the singleton instance
+   */
+  static FlagRegistry& instance() {
+    static FlagRegistry registry(
+        RegistryOptions{FLAGPP_REGISTRY_SHARDS, FLAGPP_COUNT_EVALUATIONS != 0});
+    return registry;
+  }
+
+  /**
+   * @brief Get the number of shards
+   * @return std::size_t The shard count
+   */
+  std::size_t shard_count() const noexcept { return shard_mask_ + 1; }
+
+  /**
+   * @brief Define a new flag or return existing one
+   * @tparam T The type of the flag's default value
+   * @param name The flag's name
+   * @param default_value The flag's default value
+   * @param description The flag's description (optional)
+   * @return TypedFlag Handle to the flag, typed after the default value, or
+   *         an empty handle if the registry is frozen and the name is new
+   */
+  template <typename T>
+  TypedFlag<detail::flag_storage_t<T>> define(std::string_view name,
+                                              T default_value,
+                                              std::string_view description = "") {
+    return define(detail::HashedName(name), std::move(default_value),
+                  description);
+  }
+
+  /**
+   * @brief Define a new flag or return existing one, given a prehashed name
+   * @tparam T The type of the flag's default value
+   * @param key The flag's name and its precomputed hash
+   * @param default_value The flag's default value
+   * @param description The flag's description (optional)
+   * @return TypedFlag Handle to the flag, typed after the default value, or
+   *         an empty handle if the registry is frozen and the name is new
+   */
+  template <typename T>
+  TypedFlag<detail::flag_storage_t<T>> define(detail::HashedName key,
+                                              T default_value,
+                                              std::string_view description = "") {
+    using Handle = TypedFlag<detail::flag_storage_t<T>>;
+    Shard& shard = shard_for(key);
+    std::unique_lock lock(shard.mutex);
+    
+    auto it = find_locked(shard, key);
+    if (it != shard.flags.end()) {
+      return Handle(it->second);
+    }
+    if (frozen_.load(std::memory_order_relaxed)) {
+      return Handle(); // New names are rejected once frozen
+    }
+    
+    FlagValue value(detail::flag_storage_t<T>(std::move(default_value)));
+    std::shared_ptr<Flag> flag;
+    if (arena_) {
+      auto [name, text] = arena_->copy(key.name, description);
+      flag = std::allocate_shared<Flag>(detail::ArenaAllocator<Flag>(arena_),
+                                        Flag::Borrowed{}, name, std::move(value), text);
+    } else {
+      flag = std::make_shared<Flag>(std::string(key.name), std::move(value),
+                                    std::string(description));
+    }
+    if (count_evaluations_) {
+      flag->enable_counting();
+    }
+    key.name = flag->name();
+    shard.flags.emplace(key, flag);
+    detail::generation.fetch_add(1, std::memory_order_release);
+    return Handle(flag);
+  }
+
+  /**
+   * @brief Register a flag constructed elsewhere
+   * @param flag The flag; the registry shares ownership
+   * @return bool False if the name is taken or the registry is frozen
+   */
+  bool insert(std::shared_ptr<Flag> flag) {
+    Flag* inserted = flag.get();
+    detail::HashedName key(flag->name());
+    Shard& shard = shard_for(key);
+    std::unique_lock lock(shard.mutex);
+    if (frozen_.load(std::memory_order_relaxed) ||
+        find_locked(shard, key) != shard.flags.end() ||
+        !shard.flags.emplace(key, std::move(flag)).second) {
+      return false;
+    }
+    if (count_evaluations_) {
+      inserted->enable_counting();
+    }
+    detail::generation.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Serve the flags of a source, constructing each on first lookup
+   *
+   * Lookups that miss consult the attached sources in order, so names the
+   * registry already has keep their flag. get_all(), freeze() and
+   * evaluation_counts() construct every flag the sources hold.
+   *
+   * @param source The source; the registry shares ownership
+   * @return bool False if the registry is frozen
+   */
+  bool attach(std::shared_ptr<const FlagSource> source) {
+    std::unique_lock lock(sources_mutex_);
+    if (frozen_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    sources_.push_back(std::move(source));
+    has_sources_.store(true, std::memory_order_release);
+    detail::generation.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Preallocate room for a number of flags
+   * @param count The total number of flags expected
+   */
+  void reserve(std::size_t count) {
+    for (std::size_t i = 0; i <= shard_mask_; ++i) {
+      std::unique_lock lock(shards_[i].mutex);
+      shards_[i].flags.reserve(count / (shard_mask_ + 1) + 1);
+    }
+  }
+
+  /**
+   * @brief Get a flag by name
+   * @param name The flag's name
+   * @return std::shared_ptr<Flag> Pointer to the flag, or nullptr if not found
+   */
+  std::shared_ptr<Flag> get(std::string_view name) const {
+    return get(detail::HashedName(name));
+  }
+
+  /**
+   * @brief Get a flag by prehashed name
+   * @param key The flag's name and its precomputed hash
+   * @return std::shared_ptr<Flag> Pointer to the flag, or nullptr if not found
+   */
+  std::shared_ptr<Flag> get(const detail::HashedName& key) const {
+    if (const FrozenTable* table = frozen_.load(std::memory_order_acquire)) {
+      const auto* flag = table->find(key);
+      return flag ? *flag : nullptr;
+    }
+
+    Shard& shard = shard_for(key);
+    {
+      std::shared_lock lock(shard.mutex);
+      auto it = shard.flags.find(key);
+      if (it != shard.flags.end()) {
+        return it->second;
+      }
+    }
+
+    if (!has_sources_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    std::unique_lock lock(shard.mutex);
+    auto it = find_locked(shard, key);
+    return it != shard.flags.end() ? it->second : nullptr;
+  }
+
+  /**
+   * @brief Get a typed handle to a flag by name
+   * @tparam T bool, int, double or std::string
+   * @param name The flag's name
+   * @return TypedFlag<T> Handle to the flag, or an empty handle if not found
+   */
+  template <typename T>
+  TypedFlag<T> handle(std::string_view name) const {
+    return TypedFlag<T>(get(name));
+  }
+
+  /**
+   * @brief Define a flag with a rollout, or return the existing one
+   *
+   * An existing flag is returned unchanged; use set_rollout() to change
+   * the rollout of a flag that is already defined.
+   *
+   * @tparam T The type of the flag's default value
+   * @param name The flag's name
+   * @param default_value The value for keys outside every rollout variant
+   * @param rollout The rollout
+   * @param description The flag's description (optional)
+   * @return RolloutFlag Handle to the flag, or an empty handle if rejected
+   */
+  template <typename T>
+  RolloutFlag define_rollout(std::string_view name, T default_value,
+                             Rollout rollout,
+                             std::string_view description = "") {
+    std::shared_ptr<Flag> flag =
+        define(name, std::move(default_value), description).flag();
+    if (flag && !flag->has_rollout()) {
+      flag->set_rollout(std::move(rollout));
+    }
+    return RolloutFlag(std::move(flag));
+  }
+
+  /**
+   * @brief Attach or replace a flag's rollout
+   * @param name The flag's name
+   * @param rollout The rollout
+   * @return bool True if the flag was found
+   */
+  bool set_rollout(std::string_view name, Rollout rollout) {
+    auto flag = get(name);
+    if (!flag) {
+      return false;
+    }
+    flag->set_rollout(std::move(rollout));
+    return true;
+  }
+
+  /**
+   * @brief Call a function after a flag's value changes
+   * @param name The flag's name
+   * @param callback Runs on the notifier thread with the flag and its value
+   * @return Subscription Keeps the callback registered, or an empty
+   *         subscription if the flag was not found
+   */
+  Subscription subscribe(std::string_view name,
+                         std::function<void(const Flag&, const Value&)> callback) {
+    auto flag = get(name);
+    return flag ? flag->subscribe(std::move(callback)) : Subscription();
+  }
+
+  /**
+   * @brief Compile and attach targeting rules to a flag
+   * @param name The flag's name
+   * @param rules The rules, in priority order
+   * @return bool True if the flag was found
+   */
+  bool set_rules(std::string_view name, std::vector<Rule> rules) {
+    auto flag = get(name);
+    if (!flag) {
+      return false;
+    }
+    flag->set_rules(std::move(rules));
+    return true;
+  }
+
+  /**
+   * @brief Check if a flag exists
+   * @param name The flag's name
+   * @return bool True if the flag exists, false otherwise
+   */
+  bool exists(std::string_view name) const {
+    detail::HashedName key(name);
+    if (const FrozenTable* table = frozen_.load(std::memory_order_acquire)) {
+      return table->find(key) != nullptr;
+    }
+
+    {
+      Shard& shard = shard_for(key);
+      std::shared_lock lock(shard.mutex);
+      if (shard.flags.find(key) != shard.flags.end()) {
+        return true;
+      }
+    }
+    return has_sources_.load(std::memory_order_acquire) && get(key) != nullptr;
+  }
+
+  /**
+   * @brief Update a flag's value
+   * @tparam T The type of the new value
+   * @param name The flag's name
+   * @param value The new value to set
+   * @return bool True if the flag was updated, false if not found
+   */
+  template <typename T>
+  bool update(std::string_view name, T value) {
+    auto flag = get(name);
+    if (!flag) {
+      return false;
+    }
+    
+    flag->update(std::move(value));
+    return true;
+  }
+
+  /**
+   * @brief Apply a set of changes, skipping values that are already current
+   *
+   * The changed values are committed as one Transaction, so snapshots see
+   * all of them or none; plain reads of single flags can see some before
+   * the rest. Flags whose value is unchanged are not touched: no
+   * allocation, no snapshot swap and no cache invalidation. Unknown names
+   * are ignored.
+   *
+   * @param changes Flag names and their new values
+   * @return std::size_t Number of flags whose value changed
+   */
+  std::size_t apply(const std::vector<std::pair<std::string, FlagValue>>& changes);
+
+  /**
+   * @brief Get all registered flags
+   * @return std::vector<std::shared_ptr<Flag>> Vector of all flags
+   */
+  std::vector<std::shared_ptr<Flag>> get_all() const {
+    std::vector<std::shared_ptr<Flag>> result;
+    if (const FrozenTable* table = frozen_.load(std::memory_order_acquire)) {
+      result.reserve(table->size());
+      table->for_each([&](const std::shared_ptr<Flag>& flag) {
+        result.push_back(flag);
+      });
+      return result;
+    }
+    
+    if (has_sources_.load(std::memory_order_acquire)) {
+      make_all();
+    }
+    for (std::size_t i = 0; i < shard_count(); ++i) {
+      std::shared_lock lock(shards_[i].mutex);
+      result.reserve(result.size() + shards_[i].flags.size());
+      for (const auto& [_, flag] : shards_[i].flags) {
+        result.push_back(flag);
+      }
+    }
+    
+    return result;
+  }
+
+  /**
+   * @brief Evaluate many flags by name for one context
+   *
+   * Takes each shard's lock once per run of consecutive names in that
+   * shard (once per batch with a single shard, never when frozen) and one
+   * epoch guard for the whole batch. Results are assigned in place, so
+   * string results reuse the capacity already in the output array.
+   *
+   * @param names The flags' names
+   * @param count Number of names
+   * @param context The evaluation context
+   * @param results Output array of count values; missing flags yield false
+   * @return std::size_t Number of names that were found
+   */
+  std::size_t evaluate(const std::string_view* names, std::size_t count,
+                       const EvaluationContext& context,
+                       FlagValue* results) const {
+    detail::EpochDomain::Guard guard;
+    const FrozenTable* table = frozen_.load(std::memory_order_acquire);
+    std::shared_lock<std::shared_mutex> lock;
+    const Shard* locked = nullptr;
+    std::size_t found = 0;
+
+    for (std::size_t i = 0; i < count; ++i) {
+      detail::HashedName key(names[i]);
+      const Flag* flag = nullptr;
+      if (table) {
+        const auto* entry = table->find(key);
+        flag = entry ? entry->get() : nullptr;
+      } else {
+        const Shard& shard = shard_for(key);
+        if (&shard != locked) {
+          if (lock) {
+            lock.unlock(); // Never hold two shard locks at once
+          }
+          lock = std::shared_lock(shard.mutex);
+          locked = &shard;
+        }
+        auto it = shard.flags.find(key);
+        if (it != shard.flags.end()) {
+          flag = it->second.get();
+        } else if (has_sources_.load(std::memory_order_acquire)) {
+          lock.unlock();
+          locked = nullptr;
+          flag = get(key).get(); // The registry keeps the flag alive
+        }
+      }
+
+      if (flag) {
+        results[i] = flag->evaluate_in_guard(context);
+        ++found;
+      } else {
+        results[i] = FlagValue(false);
+      }
+    }
+    return found;
+  }
+
+  /**
+   * @brief Freeze the set of defined flags
+   *
+   * Builds an immutable minimal perfect hash table over every defined name,
+   * first constructing every flag of the attached sources. Afterwards
+   * get(), exists() and get_all() take no locks, and define() returns an
+   * empty handle for names that were not defined before the freeze.
+   * Values can still be updated. Freezing is permanent.
+   *
+   * @return bool True if the registry is frozen
+   */
+  bool freeze() {
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (std::size_t i = 0; i < shard_count(); ++i) {
+      locks.emplace_back(shards_[i].mutex);
+    }
+    if (frozen_.load(std::memory_order_relaxed)) {
+      return true;
+    }
+
+    // The table replaces the sources, so construct everything they hold
+    std::unique_lock sources_lock(sources_mutex_);
+    for (const auto& source : sources_) {
+      source->for_each_name([this](std::string_view name) {
+        detail::HashedName key(name);
+        Shard& shard = shard_for(key);
+        if (shard.flags.find(key) == shard.flags.end()) {
+          make_from_sources(shard, key);
+        }
+      });
+    }
+    sources_.clear();
+    has_sources_.store(false, std::memory_order_release);
+
+    std::vector<std::pair<detail::HashedName, std::shared_ptr<Flag>>> entries;
+    for (std::size_t i = 0; i < shard_count(); ++i) {
+      for (const auto& [key, flag] : shards_[i].flags) {
+        entries.emplace_back(key, flag);
+      }
+    }
+
+    auto table = std::make_unique<FrozenTable>();
+    if (!table->build(std::move(entries))) {
+      return false;
+    }
+    frozen_storage_ = std::move(table);
+    frozen_.store(frozen_storage_.get(), std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Check whether freeze() has been called
+   * @return bool True if the registry is frozen
+   */
+  bool is_frozen() const noexcept {
+    return frozen_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  /**
+   * @brief Sum the evaluation counters of every counting flag
+   *
+   * Takes one pass over each thread's counters, so it is cheap enough to
+   * poll periodically. Flags that are never read show up with a count of
+   * zero, which makes stale flags easy to find.
+   *
+   * @return std::vector<std::pair<std::shared_ptr<Flag>, std::uint64_t>>
+   *         Each counting flag with its evaluations since counting began
+   */
+  std::vector<std::pair<std::shared_ptr<Flag>, std::uint64_t>>
+  evaluation_counts() const {
+    std::vector<std::uint64_t> totals = detail::EvaluationCounters::instance().totals();
+    std::vector<std::pair<std::shared_ptr<Flag>, std::uint64_t>> result;
+    for (auto& flag : get_all()) {
+      std::uint32_t id = flag->counter_id();
+      if (id != 0) {
+        std::uint64_t count = id < totals.size() ? totals[id] : flag->evaluation_count();
+        result.emplace_back(std::move(flag), count);
+      }
+    }
+    return result;
+  }
+
+  /**
+   * @brief Take a consistent, lock-free view of every flag
+   * @return Snapshot A view pinned at the last committed version
+   */
+  Snapshot snapshot() const;
+
+  /**
+   * @brief Start a set of changes to commit atomically
+   * @return Transaction An empty transaction on this registry
+   */
+  Transaction transaction();
+};
 
 /**
- * @brief Type-safe wrapper for flag values with conversion operators
- * 
- * Provides type-safe access to the underlying flag value with
- * convenient conversion operators for common types.
+ * @brief A consistent view of every flag's value at one committed version
+ *
+ * Taking one pins the last committed version without locks, once any
+ * single-flag write already under way has finished; reads then walk back
+ * to the value each flag had at that version, so values written together
+ * by a Transaction are seen all or not at all. Flags defined after the
+ * snapshot was taken show their default. Holding a snapshot keeps
+ * superseded values alive and sends every write through the global
+ * commit mutex, so it is meant to be short-lived.
  */
-class Value {
+class Snapshot {
 private:
-  FlagValue value_;
+  const FlagRegistry* registry_;
+  std::uint64_t version_ = 0; // Declared first: pin_'s initializer sets it
+  detail::VersionClock::Pin* pin_;
 
 public:
   /**
-   * @brief Construct a new Value object
-   * @tparam T The type of the value (must be compatible with FlagValue)
-   * @param value The value to store
+   * @brief Pin the last committed version
+   * @param registry The registry name lookups use
    */
-  template <typename T, 
-            typename = std::enable_if_t<
-              std::is_constructible_v<FlagValue, T>>>
-  explicit Value(T value) : value_(std::move(value)) {}
+  explicit Snapshot(const FlagRegistry& registry = FlagRegistry::instance())
+      : registry_(&registry),
+        pin_(detail::VersionClock::instance().pin(version_)) {}
 
-  /**
-   * @brief Get the value as the specified type
-   * @tparam T The type to retrieve
-   * @return std::optional<T> The value if it matches the requested type, or nullopt
-   */
-  template <typename T>
-  std::optional<T> get() const {
-    if (std::holds_alternative<T>(value_)) {
-      return std::get<T>(value_);
+  Snapshot(Snapshot&& other) noexcept
+      : registry_(other.registry_), version_(other.version_),
+        pin_(std::exchange(other.pin_, nullptr)) {}
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+  Snapshot& operator=(Snapshot&&) = delete;
+
+  ~Snapshot() {
+    if (pin_) {
+      detail::VersionClock::instance().unpin(pin_);
     }
-    return std::nullopt;
   }
 
   /**
-   * @brief Convert to boolean
-   * @return bool The value as a boolean, or false if not a boolean
+   * @brief Get the pinned version
    */
-  explicit operator bool() const {
-    auto val = get<bool>();
-    return val.has_value() ? *val : false;
-  }
+  std::uint64_t version() const noexcept { return version_; }
 
   /**
-   * @brief Convert to integer
-   * @return int The value as an integer, or 0 if not an integer
+   * @brief Read a flag as of the snapshot
+   * @param flag The flag
+   * @return Value The flag's value at the pinned version
    */
-  explicit operator int() const {
-    auto val = get<int>();
-    return val.has_value() ? *val : 0;
+  Value value(const Flag& flag) const {
+    flag.record_evaluation();
+    return flag.value_at(version_);
   }
 
   /**
-   * @brief Convert to double
-   * @return double The value as a double, or 0.0 if not a double
+   * @brief Check if a boolean flag was enabled as of the snapshot
+   * @param name The flag's name
+   * @return bool True if the flag exists and was enabled, false otherwise
    */
-  explicit operator double() const {
-    auto val = get<double>();
-    return val.has_value() ? *val : 0.0;
+  bool is_enabled(std::string_view name) const {
+    return get_value<bool>(name).value_or(false);
   }
 
   /**
-   * @brief Convert to string
-   * @return std::string The value as a string, or empty string if not a string
+   * @brief Get a flag's value as of the snapshot, with type checking
+   * @tparam T The expected type of the flag's value
+   * @param name The flag's name
+   * @return std::optional<T> The value if the flag exists and matches the type, or nullopt
    */
-  explicit operator std::string() const {
-    auto val = get<std::string>();
-    return val.has_value() ? *val : "";
+  template <typename T>
+  std::optional<T> get_value(std::string_view name) const {
+    auto flag = registry_->get(name);
+    if (!flag) {
+      return std::nullopt;
+    }
+    flag->record_evaluation();
+    detail::EpochDomain::Guard guard;
+    const T* typed = std::get_if<T>(&flag->snapshot_at(version_));
+    return typed ? std::optional<T>(*typed) : std::nullopt;
   }
 };
 
 /**
- * @brief Represents a feature flag with thread-safe access
- * 
- * Stores the flag's name, value, and description with mutex
- * protection for thread-safe access.
+ * @brief A set of flag changes committed atomically
+ *
+ * Nothing is visible until commit(), which publishes every change at one
+ * version under the global commit lock. Snapshots see all of the changes
+ * or none; plain reads of a single flag may see it change a moment
+ * before the others.
  */
-class Flag {
+class Transaction {
 private:
-  std::string name_;
-  FlagValue value_;
-  std::string description_;
-  mutable std::shared_mutex mutex_; // Use shared_mutex for reader-writer lock
+  FlagRegistry* registry_;
+  std::vector<std::pair<std::shared_ptr<Flag>, FlagValue>> writes_;
 
 public:
   /**
-   * @brief Construct a new Flag object
-   * @param name The flag's name
-   * @param default_value The flag's default value
-   * @param description The flag's description (optional)
+   * @brief Start an empty transaction
+   * @param registry The registry name lookups use
    */
-  Flag(std::string name, FlagValue default_value, std::string description = "")
-      : name_(std::move(name)), value_(std::move(default_value)),
-        description_(std::move(description)) {}
+  explicit Transaction(FlagRegistry& registry = FlagRegistry::instance())
+      : registry_(&registry) {}
 
   /**
-   * @brief Get the flag's name
-   * @return std::string_view The flag's name
+   * @brief Stage a new value by name
+   * @tparam T The type of the new value
+   * @param name The flag's name
+   * @param value The new value
+   * @return bool False if the flag was not found
    */
-  std::string_view name() const { return name_; }
+  template <typename T>
+  bool set(std::string_view name, T value) {
+    auto flag = registry_->get(name);
+    if (!flag) {
+      return false;
+    }
+    set(std::move(flag), std::move(value));
+    return true;
+  }
 
   /**
-   * @brief Get the flag's description
-   * @return std::string_view The flag's description
+   * @brief Stage a new value for a flag held by handle
+   * @tparam T The type of the new value
+   * @param flag The flag
+   * @param value The new value
    */
-  std::string_view description() const { return description_; }
+  template <typename T>
+  void set(std::shared_ptr<Flag> flag, T value) {
+    writes_.emplace_back(std::move(flag), FlagValue(std::move(value)));
+  }
 
   /**
-   * @brief Get the flag's current value
-   * @return Value The flag's value wrapped in a Value object
+   * @brief Get the number of staged changes
    */
-  Value value() const { 
-    std::shared_lock lock(mutex_); // Read lock
-    return Value(value_); 
-  }
+  std::size_t size() const noexcept { return writes_.size(); }
 
   /**
-   * @brief Update the flag's value
-   * @tparam T The type of the new value (must be compatible with FlagValue)
-   * @param new_value The new value to set
+   * @brief Publish every staged change at one version and clear them
    */
-  template <typename T>
-  void update(T new_value) {
-    std::unique_lock lock(mutex_); // Write lock
-    value_ = FlagValue(std::move(new_value));
+  void commit() {
+    if (writes_.empty()) {
+      return;
+    }
+    std::vector<std::pair<Flag*, detail::ValueNode*>> nodes;
+    nodes.reserve(writes_.size());
+    for (auto& [flag, value] : writes_) {
+      nodes.emplace_back(flag.get(), new detail::ValueNode(std::move(value)));
+    }
+    Flag::commit(nodes.data(), nodes.size());
+    writes_.clear();
   }
 };
 
+inline Snapshot FlagRegistry::snapshot() const { return Snapshot(*this); }
+
+inline Transaction FlagRegistry::transaction() { return Transaction(*this); }
+
+inline std::size_t FlagRegistry::apply(
+    const std::vector<std::pair<std::string, FlagValue>>& changes) {
+  Transaction transaction(*this);
+  for (const auto& [name, value] : changes) {
+    auto flag = get(name);
+    if (!flag) {
+      continue;
+    }
+    bool current;
+    {
+      detail::EpochDomain::Guard guard;
+      current = flag->snapshot() == value;
+    }
+    if (!current) {
+      transaction.set(std::move(flag), value);
+    }
+  }
+  std::size_t changed = transaction.size();
+  transaction.commit();
+  return changed;
+}
+
 /**
- * @brief Singleton registry for all feature flags
- * 
- * Provides thread-safe storage and access to all feature flags
- * in the application.
+ * @brief A flag with static storage duration, declared at namespace scope
+ *
+ * Registers itself with the global registry during static initialization
+ * using a name hash computed at compile time. Reading it goes straight to
+ * the flag through its typed handle, with no string hashing or lookup.
+ * Declare these with the FLAGPP_DEFINE_* macros rather than directly.
+ *
+ * @tparam T bool, int, double or std::string
  */
-class FlagRegistry {
+template <typename T>
+class StaticFlag {
 private:
-  mutable std::shared_mutex mutex_;
-  std::unordered_map<std::string, std::shared_ptr<Flag>> flags_;
-
-  // Private constructor for singleton
-  FlagRegistry() = default;
+  TypedFlag<T> handle_;
 
 public:
-  // Delete copy/move constructors and assignment operators
-  FlagRegistry(const FlagRegistry&) = delete;
-  FlagRegistry& operator=(const FlagRegistry&) = delete;
-  FlagRegistry(FlagRegistry&&) = delete;
-  FlagRegistry& operator=(FlagRegistry&&) = delete;
+  /**
+   * @brief Register the flag with the global registry
+   * @param key The flag's name and its precomputed hash
+   * @param default_value The flag's default value
+   * @param description The flag's description
+   */
+  StaticFlag(const detail::HashedName& key, T default_value,
+             std::string_view description)
+      : handle_(FlagRegistry::instance().define(key, std::move(default_value),
+                                                description)) {}
+
+  StaticFlag(const StaticFlag&) = delete;
+  StaticFlag& operator=(const StaticFlag&) = delete;
 
   /**
-   * @brief Get the singleton instance
-   * @return FlagRegistry& Reference to the singleton instance
+   * @brief Read the flag's current value
+   * @return T The value, or the type's default if the flag holds another type
    */
-  static FlagRegistry& instance() {
-    static FlagRegistry registry;
-    return registry;
-  }
+  T load() const { return handle_.load(); }
 
   /**
-   * @brief Define a new flag or return existing one
-   * @tparam T The type of the flag's default value
-   * @param name The flag's name
-   * @param default_value The flag's default value
-   * @param description The flag's description (optional)
-   * @return std::shared_ptr<Flag> Pointer to the flag
+   * @brief Update the flag's value
+   * @param value The new value to set
    */
-  template <typename T>
-  std::shared_ptr<Flag> define(const std::string& name, T default_value,
-                              const std::string& description = "") {
-    std::unique_lock lock(mutex_);
-    
-    auto it = flags_.find(name);
-    if (it != flags_.end()) {
-      return it->second;
-    }
-    
-    auto flag = std::make_shared<Flag>(name, FlagValue(std::move(default_value)), 
-                                      description);
-    flags_[name] = flag;
-    return flag;
-  }
+  void update(T value) const { handle_.update(std::move(value)); }
 
   /**
-   * @brief Get a flag by name
-   * @param name The flag's name
-   * @return std::shared_ptr<Flag> Pointer to the flag, or nullptr if not found
+   * @brief Get the typed handle
+   * @return const TypedFlag<T>& The handle
    */
-  std::shared_ptr<Flag> get(const std::string& name) const {
-    std::shared_lock lock(mutex_);
-    
-    auto it = flags_.find(name);
-    if (it != flags_.end()) {
-      return it->second;
+  const TypedFlag<T>& handle() const noexcept { return handle_; }
+
+  Flag* operator->() const noexcept { return handle_.operator->(); }
+};
+
+/**
+ * @brief Per-thread cache of flag values in front of FlagRegistry::get
+ *
+ * Entries remember the global generation they were read at. While nothing
+ * is updated or defined, a lookup is one relaxed load of the generation
+ * plus a local hash map probe; the registry's locks are never touched.
+ * A stale entry is refreshed from its flag's snapshot on next use. Lookups
+ * of unknown names are not cached and always reach the registry.
+ *
+ * A FlagCache is not thread-safe; use one per thread, e.g. local_cache().
+ */
+class FlagCache {
+private:
+  struct Entry {
+    std::shared_ptr<Flag> flag;
+    FlagValue value;
+    std::uint64_t generation;
+  };
+
+  const FlagRegistry* registry_;
+  std::unordered_map<detail::HashedName, Entry, detail::HashedNameHash> entries_;
+
+  const FlagValue* find(std::string_view name) {
+    const std::uint64_t current =
+        detail::generation.load(std::memory_order_relaxed);
+    detail::HashedName key(name);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      auto flag = registry_->get(key);
+      if (!flag) {
+        return nullptr;
+      }
+      key.name = flag->name();
+      it = entries_.emplace(key, Entry{flag, FlagValue{}, 0}).first;
     }
-    
-    return nullptr;
+
+    Entry& entry = it->second;
+    if (entry.generation != current) {
+      // Re-read with acquire so the refresh sees the snapshot the bump
+      // announced
+      entry.generation = detail::generation.load(std::memory_order_acquire);
+      detail::EpochDomain::Guard guard;
+      entry.value = entry.flag->snapshot();
+    }
+    entry.flag->record_evaluation();
+    return &entry.value;
   }
 
+public:
   /**
-   * @brief Check if a flag exists
+   * @brief Construct an empty cache
+   * @param registry The registry to cache lookups from
+   */
+  explicit FlagCache(const FlagRegistry& registry = FlagRegistry::instance())
+      : registry_(&registry) {}
+
+  /**
+   * @brief Check if a boolean flag is enabled
    * @param name The flag's name
-   * @return bool True if the flag exists, false otherwise
+   * @return bool True if the flag exists and is enabled, false otherwise
    */
-  bool exists(const std::string& name) const {
-    std::shared_lock lock(mutex_);
-    return flags_.find(name) != flags_.end();
+  bool is_enabled(std::string_view name) {
+    const FlagValue* value = find(name);
+    const bool* enabled = value ? std::get_if<bool>(value) : nullptr;
+    return enabled && *enabled;
   }
 
   /**
-   * @brief Update a flag's value
-   * @tparam T The type of the new value
+   * @brief Get a flag's value with type checking
+   * @tparam T The expected type of the flag's value
    * @param name The flag's name
-   * @param value The new value to set
-   * @return bool True if the flag was updated, false if not found
+   * @return std::optional<T> The flag's value if it exists and matches the type, or nullopt
    */
   template <typename T>
-  bool update(const std::string& name, T value) {
-    auto flag = get(name);
-    if (!flag) {
-      return false;
-    }
-    
-    flag->update(std::move(value));
-    return true;
+  std::optional<T> get_value(std::string_view name) {
+    const FlagValue* value = find(name);
+    const T* typed = value ? std::get_if<T>(value) : nullptr;
+    return typed ? std::optional<T>(*typed) : std::nullopt;
   }
 
   /**
-   * @brief Get all registered flags
-   * @return std::vector<std::shared_ptr<Flag>> Vector of all flags
+   * @brief Drop every cached entry
    */
-  std::vector<std::shared_ptr<Flag>> get_all() const {
-    std::shared_lock lock(mutex_);
-    std::vector<std::shared_ptr<Flag>> result;
-    result.reserve(flags_.size());
-    
-    for (const auto& [_, flag] : flags_) {
-      result.push_back(flag);
-    }
-    
-    return result;
-  }
+  void clear() { entries_.clear(); }
 };
 
+/**
+ * @brief Evaluate many flags held by handle for one context
+ *
+ * Takes one epoch guard for the whole batch and no registry locks.
+ * Results are assigned in place, so string results reuse the capacity
+ * already in the output array.
+ *
+ * @tparam Handle std::shared_ptr<Flag>, TypedFlag, RolloutFlag or Flag*
+ * @param handles The flags; none may be empty
+ * @param count Number of handles
+ * @param context The evaluation context
+ * @param results Output array of count values
+ */
+template <typename Handle>
+void evaluate(const Handle* handles, std::size_t count,
+              const EvaluationContext& context, FlagValue* results) {
+  detail::EpochDomain::Guard guard;
+  for (std::size_t i = 0; i < count; ++i) {
+    const Flag& flag = *handles[i];
+    results[i] = flag.evaluate_in_guard(context);
+  }
+}
+
 /**
  * @brief Convenience functions for working with flags
  * 
@@ -294,11 +3892,12 @@ namespace flags {
  * @param name The flag's name
  * @param default_value The flag's default value
  * @param description The flag's description (optional)
- * @return std::shared_ptr<Flag> Pointer to the flag
+ * @return TypedFlag Handle to the flag, typed after the default value
  */
 template <typename T>
-std::shared_ptr<Flag> define(const std::string& name, T default_value,
-                            const std::string& description = "") {
+TypedFlag<detail::flag_storage_t<T>> define(std::string_view name,
+                                            T default_value,
+                                            std::string_view description = "") {
   return FlagRegistry::instance().define(name, std::move(default_value), 
                                         description);
 }
@@ -308,16 +3907,27 @@ std::shared_ptr<Flag> define(const std::string& name, T default_value,
  * @param name The flag's name
  * @return std::shared_ptr<Flag> Pointer to the flag, or nullptr if not found
  */
-inline std::shared_ptr<Flag> get(const std::string& name) {
+inline std::shared_ptr<Flag> get(std::string_view name) {
   return FlagRegistry::instance().get(name);
 }
 
+/**
+ * @brief Get a typed handle to a flag by name
+ * @tparam T bool, int, double or std::string
+ * @param name The flag's name
+ * @return TypedFlag<T> Handle to the flag, or an empty handle if not found
+ */
+template <typename T>
+TypedFlag<T> handle(std::string_view name) {
+  return FlagRegistry::instance().handle<T>(name);
+}
+
 /**
  * @brief Check if a flag exists
  * @param name The flag's name
  * @return bool True if the flag exists, false otherwise
  */
-inline bool exists(const std::string& name) {
+inline bool exists(std::string_view name) {
   return FlagRegistry::instance().exists(name);
 }
 
@@ -326,7 +3936,7 @@ inline bool exists(const std::string& name) {
  * @param name The flag's name
  * @return bool True if the flag exists and is enabled, false otherwise
  */
-inline bool is_enabled(const std::string& name) {
+inline bool is_enabled(std::string_view name) {
   auto flag = get(name);
   return flag ? static_cast<bool>(flag->value()) : false;
 }
@@ -338,7 +3948,7 @@ inline bool is_enabled(const std::string& name) {
  * @return std::optional<T> The flag's value if it exists and matches the type, or nullopt
  */
 template <typename T>
-std::optional<T> get_value(const std::string& name) {
+std::optional<T> get_value(std::string_view name) {
   auto flag = get(name);
   if (!flag) {
     return std::nullopt;
@@ -346,6 +3956,92 @@ std::optional<T> get_value(const std::string& name) {
   return flag->value().get<T>();
 }
 
+/**
+ * @brief Define a flag with a rollout, or return the existing one
+ * @tparam T The type of the flag's default value
+ * @param name The flag's name
+ * @param default_value The value for keys outside every rollout variant
+ * @param rollout The rollout
+ * @param description The flag's description (optional)
+ * @return RolloutFlag Handle to the flag
+ */
+template <typename T>
+RolloutFlag define_rollout(std::string_view name, T default_value,
+                           Rollout rollout, std::string_view description = "") {
+  return FlagRegistry::instance().define_rollout(
+      name, std::move(default_value), std::move(rollout), description);
+}
+
+/**
+ * @brief Attach or replace a flag's rollout
+ * @param name The flag's name
+ * @param rollout The rollout
+ * @return bool True if the flag was found
+ */
+inline bool set_rollout(std::string_view name, Rollout rollout) {
+  return FlagRegistry::instance().set_rollout(name, std::move(rollout));
+}
+
+/**
+ * @brief Compile and attach targeting rules to a flag
+ * @param name The flag's name
+ * @param rules The rules, in priority order
+ * @return bool True if the flag was found
+ */
+inline bool set_rules(std::string_view name, std::vector<Rule> rules) {
+  return FlagRegistry::instance().set_rules(name, std::move(rules));
+}
+
+/**
+ * @brief Call a function after a flag's value changes
+ * @param name The flag's name
+ * @param callback Runs on the notifier thread with the flag and its value
+ * @return Subscription Keeps the callback registered, or an empty
+ *         subscription if the flag was not found
+ */
+inline Subscription subscribe(std::string_view name,
+                              std::function<void(const Flag&, const Value&)> callback) {
+  return FlagRegistry::instance().subscribe(name, std::move(callback));
+}
+
+/**
+ * @brief Check whether a flag is on for a per-request key
+ * @tparam Key std::string_view or std::uint64_t
+ * @param name The flag's name
+ * @param key The per-request key
+ * @return bool True if the flag exists and evaluates to true for the key
+ */
+template <typename Key>
+bool is_enabled_for(std::string_view name, const Key& key) {
+  auto flag = get(name);
+  return flag ? flag->is_enabled_for(key) : false;
+}
+
+/**
+ * @brief Evaluate many flags by name for one context
+ * @param names The flags' names
+ * @param count Number of names
+ * @param context The evaluation context
+ * @param results Output array of count values; missing flags yield false
+ * @return std::size_t Number of names that were found
+ */
+inline std::size_t evaluate(const std::string_view* names, std::size_t count,
+                            const EvaluationContext& context,
+                            FlagValue* results) {
+  return FlagRegistry::instance().evaluate(names, count, context, results);
+}
+
+/**
+ * @brief Read a string flag's value without copying it
+ * @param name The flag's name
+ * @return StringRef Reference to the string, or an empty reference if the
+ *         flag does not exist or does not hold a string
+ */
+inline StringRef get_string_ref(std::string_view name) {
+  auto flag = get(name);
+  return flag ? flag->string_ref() : StringRef();
+}
+
 /**
  * @brief Update a flag's value
  * @tparam T The type of the new value
@@ -354,10 +4050,22 @@ std::optional<T> get_value(const std::string& name) {
  * @return bool True if the flag was updated, false if not found
  */
 template <typename T>
-bool update(const std::string& name, T value) {
+bool update(std::string_view name, T value) {
   return FlagRegistry::instance().update(name, std::move(value));
 }
 
+/**
+ * @brief Take a consistent, lock-free view of every flag
+ * @return Snapshot A view pinned at the last committed version
+ */
+inline Snapshot snapshot() { return FlagRegistry::instance().snapshot(); }
+
+/**
+ * @brief Start a set of changes to commit atomically
+ * @return Transaction An empty transaction on the global registry
+ */
+inline Transaction transaction() { return FlagRegistry::instance().transaction(); }
+
 /**
  * @brief Get all registered flags
  * @return std::vector<std::shared_ptr<Flag>> Vector of all flags
@@ -366,8 +4074,63 @@ inline std::vector<std::shared_ptr<Flag>> get_all() {
   return FlagRegistry::instance().get_all();
 }
 
+/**
+ * @brief Sum the evaluation counters of every counting flag
+ * @return std::vector<std::pair<std::shared_ptr<Flag>, std::uint64_t>>
+ *         Each counting flag with its evaluations since counting began
+ */
+inline std::vector<std::pair<std::shared_ptr<Flag>, std::uint64_t>>
+evaluation_counts() {
+  return FlagRegistry::instance().evaluation_counts();
+}
+
+/**
+ * @brief Get the calling thread's cache over the global registry
+ * @return FlagCache& The thread-local cache
+ */
+inline FlagCache& local_cache() {
+  thread_local FlagCache cache;
+  return cache;
+}
+
 } // namespace flags
 
 } // namespace flagpp
 
+/**
+ * @brief Define a static flag at namespace scope
+ *
+ * Creates `FLAGPP_<name>`, a flagpp::StaticFlag<type> registered under the
+ * name `<name>`. The name is hashed at compile time. Use in one translation
+ * unit and pair with FLAGPP_DECLARE_FLAG where the flag is used elsewhere;
+ * the definition has external linkage so other units can link to it.
+ */
+#define FLAGPP_DEFINE_FLAG(type, name, default_value, description)           \
+  extern const ::flagpp::StaticFlag<type> FLAGPP_##name(                     \
+      [] {                                                                   \
+        constexpr ::flagpp::detail::HashedName key(#name);                   \
+        return key;                                                          \
+      }(),                                                                   \
+      type(default_value), description)
+
+/**
+ * @brief Declare a static flag defined in another translation unit
+ */
+#define FLAGPP_DECLARE_FLAG(type, name)                                      \
+  extern const ::flagpp::StaticFlag<type> FLAGPP_##name
+
+#define FLAGPP_DEFINE_BOOL(name, default_value, description)                 \
+  FLAGPP_DEFINE_FLAG(bool, name, default_value, description)
+#define FLAGPP_DEFINE_INT(name, default_value, description)                  \
+  FLAGPP_DEFINE_FLAG(int, name, default_value, description)
+#define FLAGPP_DEFINE_DOUBLE(name, default_value, description)               \
+  FLAGPP_DEFINE_FLAG(double, name, default_value, description)
+#define FLAGPP_DEFINE_STRING(name, default_value, description)               \
+  FLAGPP_DEFINE_FLAG(std::string, name, default_value, description)
+
+#define FLAGPP_DECLARE_BOOL(name) FLAGPP_DECLARE_FLAG(bool, name)
+#define FLAGPP_DECLARE_INT(name) FLAGPP_DECLARE_FLAG(int, name)
+#define FLAGPP_DECLARE_DOUBLE(name) FLAGPP_DECLARE_FLAG(double, name)
+#define FLAGPP_DECLARE_STRING(name) FLAGPP_DECLARE_FLAG(std::string, name)
+
 #endif // FLAGPP_HPP
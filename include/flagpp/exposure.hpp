@@ -0,0 +1,539 @@
+/**
+ * @file exposure.hpp
+ * @brief Sampled exposure logging: which key saw which value of which flag
+ *
+ * An ExposureLog attaches to flags and records their keyed evaluations
+ * (evaluate, is_enabled_for, batch evaluation) without slowing them down:
+ * the evaluating thread samples the key, copies the event into its own
+ * single-producer ring and returns. A background flusher drains every
+ * ring, drops duplicates within the batch and hands the batch to a sink.
+ *
+ * Sampling is by key hash, so a key is either always or never logged and
+ * experiment groups stay intact. A full ring drops the event and counts
+ * it; dropped() makes backpressure visible.
+ */
+
+#ifndef FLAGPP_EXPOSURE_HPP
+#define FLAGPP_EXPOSURE_HPP
+
+#include <flagpp.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace flagpp {
+
+/**
+ * @brief One logged evaluation; exactly one cache line
+ */
+struct Exposure {
+  static constexpr std::size_t max_key_size = 42;
+
+  const Flag* flag;          // Kept alive by the log that recorded it
+  std::int64_t time_ns;      // System clock, since the epoch
+  std::uint32_t index;       // Rule or variant index; UINT32_MAX for the value
+  ExposureSource source;
+  std::uint8_t key_size;     // Longer keys are truncated
+  char key_data[max_key_size]; // String keys as given, numeric keys in decimal
+
+  /**
+   * @brief Get the key the flag was evaluated for
+   */
+  std::string_view key() const noexcept { return std::string_view(key_data, key_size); }
+};
+
+static_assert(sizeof(Exposure) == detail::cache_line_size,
+              "an exposure should fill one cache line");
+
+/**
+ * @brief ExposureLog configuration
+ */
+struct ExposureOptions {
+  /**
+   * @brief Fraction of keys whose exposures are logged, from 0 to 1
+   *
+   * Rates outside that range are clamped; NaN logs nothing.
+   */
+  double sample_rate = 1.0;
+
+  /**
+   * @brief Seed of the sampling hash; change it to sample other keys
+   */
+  std::uint64_t sample_seed = 0;
+
+  /**
+   * @brief Events each thread can buffer, rounded up to a power of two
+   */
+  std::size_t ring_capacity = 4096;
+
+  /**
+   * @brief How often the flusher drains the rings
+   */
+  std::chrono::milliseconds flush_interval{1000};
+};
+
+namespace detail {
+
+namespace exposure {
+
+/**
+ * @brief Single-producer single-consumer event ring owned by one thread
+ */
+struct Ring {
+  std::unique_ptr<Exposure[]> slots;
+  std::size_t mask;
+  std::uint64_t log_id;
+
+  alignas(cache_line_size) std::atomic<std::size_t> head{0}; // Producer
+  std::atomic<std::size_t> cached_tail{0};                   // Producer's view
+  std::atomic<std::uint64_t> dropped{0};                     // Producer
+  std::atomic<bool> in_use{false};
+  std::atomic<bool> closed{false}; // Set when the log is destroyed
+
+  alignas(cache_line_size) std::atomic<std::size_t> tail{0}; // Consumer
+
+  Ring(std::size_t capacity, std::uint64_t log_id)
+      : slots(new Exposure[capacity]), mask(capacity - 1), log_id(log_id) {}
+
+  void push(const Exposure& event) noexcept {
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if (h - cached_tail.load(std::memory_order_relaxed) > mask) {
+      cached_tail.store(tail.load(std::memory_order_acquire), std::memory_order_relaxed);
+      if (h - cached_tail.load(std::memory_order_relaxed) > mask) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+        return;
+      }
+    }
+    slots[h & mask] = event;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  template <typename Out>
+  void drain(Out& out) {
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    std::size_t h = head.load(std::memory_order_acquire);
+    for (; t != h; ++t) {
+      out.push_back(slots[t & mask]);
+    }
+    tail.store(t, std::memory_order_release);
+  }
+};
+
+// The rings the calling thread owns, released when it exits so another
+// thread can take them over
+struct LocalRings {
+  std::vector<std::shared_ptr<Ring>> rings;
+  ~LocalRings() {
+    for (auto& ring : rings) {
+      ring->in_use.store(false, std::memory_order_release);
+    }
+  }
+};
+
+inline std::atomic<std::uint64_t> next_log_id{1};
+
+/**
+ * @brief The part of a log that evaluating threads touch
+ *
+ * Retired through the epoch domain, so evaluations that loaded it before
+ * it was detached can finish safely.
+ */
+class Core final : public ExposureSink {
+private:
+  std::uint64_t id_ = next_log_id.fetch_add(1, std::memory_order_relaxed);
+  std::uint64_t threshold_;
+  std::uint64_t seed_;
+  std::size_t capacity_;
+
+  mutable std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+
+  FLAGPP_COLD Ring* attach() {
+    thread_local LocalRings local;
+    auto& owned = local.rings;
+    owned.erase(std::remove_if(owned.begin(), owned.end(),
+                               [](const std::shared_ptr<Ring>& ring) {
+                                 if (!ring->closed.load(std::memory_order_acquire)) {
+                                   return false;
+                                 }
+                                 ring->in_use.store(false, std::memory_order_release);
+                                 return true;
+                               }),
+                owned.end());
+    for (auto& ring : owned) {
+      if (ring->log_id == id_) {
+        return ring.get();
+      }
+    }
+
+    std::shared_ptr<Ring> ring;
+    {
+      std::lock_guard lock(rings_mutex_);
+      for (auto& candidate : rings_) {
+        bool expected = false;
+        if (!candidate->in_use.load(std::memory_order_relaxed) &&
+            candidate->in_use.compare_exchange_strong(expected, true,
+                                                      std::memory_order_acquire)) {
+          ring = candidate;
+          break;
+        }
+      }
+      if (!ring) {
+        ring = std::make_shared<Ring>(capacity_, id_);
+        ring->in_use.store(true, std::memory_order_relaxed);
+        rings_.push_back(ring);
+      }
+    }
+    owned.push_back(ring);
+    return ring.get();
+  }
+
+  Ring* local_ring() {
+    // One entry covers the common case of a single log
+    static thread_local std::pair<std::uint64_t, Ring*> cached{0, nullptr};
+    if (cached.first != id_) {
+      cached = {id_, attach()};
+    }
+    return cached.second;
+  }
+
+public:
+  explicit Core(const ExposureOptions& options)
+      : seed_(options.sample_seed) {
+    // Range-checked as a double first, so the conversion is always
+    // defined; a NaN rate samples nothing
+    constexpr double two_to_64 = 18446744073709551616.0;
+    const double scaled = options.sample_rate * two_to_64;
+    if (!(scaled > 0.0)) {
+      threshold_ = 0;
+    } else if (scaled >= two_to_64) {
+      threshold_ = UINT64_MAX;
+    } else {
+      threshold_ = static_cast<std::uint64_t>(scaled);
+    }
+    capacity_ = 1;
+    while (capacity_ < std::max<std::size_t>(options.ring_capacity, 2)) {
+      capacity_ <<= 1;
+    }
+  }
+
+  ~Core() {
+    for (auto& ring : rings_) {
+      ring->closed.store(true, std::memory_order_release);
+    }
+  }
+
+  bool sampled(std::uint64_t hash) const noexcept {
+    return threshold_ == UINT64_MAX || hash < threshold_;
+  }
+
+  static Exposure make_event(const Flag& flag, ExposureSource source,
+                             std::size_t index) noexcept {
+    Exposure event;
+    event.flag = &flag;
+    event.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count();
+    event.index = index == Rollout::npos ? UINT32_MAX : static_cast<std::uint32_t>(index);
+    event.source = source;
+    return event;
+  }
+
+  void record(const Flag& flag, std::string_view key, ExposureSource source,
+              std::size_t index) noexcept override {
+    if (!sampled(hash_bytes(key, seed_))) {
+      return;
+    }
+    Exposure event = make_event(flag, source, index);
+    event.key_size = static_cast<std::uint8_t>(std::min(key.size(), Exposure::max_key_size));
+    std::memcpy(event.key_data, key.data(), event.key_size);
+    local_ring()->push(event);
+  }
+
+  void record(const Flag& flag, std::uint64_t key, ExposureSource source,
+              std::size_t index) noexcept override {
+    if (!sampled(hash_u64(key, seed_))) {
+      return;
+    }
+    Exposure event = make_event(flag, source, index);
+    auto result = std::to_chars(event.key_data, event.key_data + Exposure::max_key_size, key);
+    event.key_size = static_cast<std::uint8_t>(result.ptr - event.key_data);
+    local_ring()->push(event);
+  }
+
+  template <typename Out>
+  void drain(Out& out) {
+    std::lock_guard lock(rings_mutex_);
+    for (auto& ring : rings_) {
+      ring->drain(out);
+    }
+  }
+
+  std::uint64_t dropped() const {
+    std::lock_guard lock(rings_mutex_);
+    std::uint64_t sum = 0;
+    for (const auto& ring : rings_) {
+      sum += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+};
+
+struct SameExposure {
+  const std::vector<Exposure>* batch;
+
+  std::size_t operator()(std::size_t i) const noexcept {
+    const Exposure& e = (*batch)[i];
+    return static_cast<std::size_t>(hash_bytes(
+        e.key(), reinterpret_cast<std::uintptr_t>(e.flag) ^
+                     (std::uint64_t{e.index} << 8) ^ static_cast<std::uint64_t>(e.source)));
+  }
+
+  bool operator()(std::size_t a, std::size_t b) const noexcept {
+    const Exposure& x = (*batch)[a];
+    const Exposure& y = (*batch)[b];
+    return x.flag == y.flag && x.index == y.index && x.source == y.source &&
+           x.key() == y.key();
+  }
+};
+
+inline void write_json_string(std::string& out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out += escape;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+} // namespace exposure
+
+} // namespace detail
+
+/**
+ * @brief Logs sampled, deduplicated flag exposures to a sink in batches
+ *
+ * Attach flags with track(). Each batch holds the events drained since
+ * the last one, with repeats of the same flag, key and value collapsed
+ * into their first occurrence. The sink is called on the flusher thread,
+ * or on the caller of flush(), never concurrently. Tracked flags are kept
+ * alive by the log.
+ */
+class ExposureLog {
+public:
+  /**
+   * @brief Receives each batch; the events are valid only during the call
+   */
+  using Sink = std::function<void(const Exposure* events, std::size_t count)>;
+
+private:
+  Sink sink_;
+  std::chrono::milliseconds interval_;
+  detail::exposure::Core* core_;
+  std::vector<std::shared_ptr<Flag>> flags_;
+  std::mutex flags_mutex_;
+
+  std::mutex flush_mutex_; // Serialises draining and sink calls
+  std::vector<Exposure> batch_;
+  std::vector<Exposure> unique_;
+  std::atomic<std::uint64_t> delivered_{0};
+  std::atomic<std::uint64_t> duplicates_{0};
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stopping_ = false;
+  std::thread flusher_;
+
+  void run() {
+    std::unique_lock lock(stop_mutex_);
+    while (!stopping_) {
+      stop_cv_.wait_for(lock, interval_);
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+public:
+  /**
+   * @brief Start a log and its flusher thread
+   * @param sink Receives every batch
+   * @param options Sampling, buffering and flushing configuration
+   */
+  explicit ExposureLog(Sink sink, ExposureOptions options = {})
+      : sink_(std::move(sink)), interval_(options.flush_interval),
+        core_(new detail::exposure::Core(options)) {
+    flusher_ = std::thread([this] { run(); });
+  }
+
+  ExposureLog(const ExposureLog&) = delete;
+  ExposureLog& operator=(const ExposureLog&) = delete;
+
+  /**
+   * @brief Detach from every flag, deliver what is buffered and stop
+   */
+  ~ExposureLog() {
+    {
+      std::lock_guard lock(flags_mutex_);
+      for (auto& flag : flags_) {
+        detail::ExposureSink* expected = core_;
+        flag->exchange_exposure_sink(expected, nullptr);
+      }
+    }
+    {
+      std::lock_guard lock(stop_mutex_);
+      stopping_ = true;
+    }
+    stop_cv_.notify_one();
+    flusher_.join();
+    flush();
+    // Evaluations may still hold the core; free it once they are done
+    detail::EpochDomain::instance().retire(core_);
+  }
+
+  /**
+   * @brief Log the keyed evaluations of a flag
+   * @param flag The flag
+   * @return bool False if the flag is empty or already reports to another log
+   */
+  bool track(std::shared_ptr<Flag> flag) {
+    if (!flag) {
+      return false;
+    }
+    // Another log may be attaching to the same flag; only one wins
+    std::lock_guard lock(flags_mutex_);
+    detail::ExposureSink* previous = nullptr;
+    if (!flag->exchange_exposure_sink(previous, core_)) {
+      return previous == core_;
+    }
+    flags_.push_back(std::move(flag));
+    return true;
+  }
+
+  /**
+   * @brief Log the keyed evaluations of a registry's flag
+   * @param registry The registry
+   * @param name The flag's name
+   * @return bool False if the flag is unknown or reports to another log
+   */
+  bool track(const FlagRegistry& registry, std::string_view name) {
+    return track(registry.get(name));
+  }
+
+  /**
+   * @brief Drain every thread's buffer and deliver one batch now
+   */
+  void flush() {
+    std::lock_guard lock(flush_mutex_);
+    batch_.clear();
+    core_->drain(batch_);
+    if (batch_.empty()) {
+      return;
+    }
+
+    unique_.clear();
+    detail::exposure::SameExposure same{&unique_};
+    std::unordered_set<std::size_t, detail::exposure::SameExposure,
+                       detail::exposure::SameExposure>
+        seen(batch_.size(), same, same);
+    unique_.reserve(batch_.size());
+    for (const Exposure& event : batch_) {
+      unique_.push_back(event);
+      if (!seen.insert(unique_.size() - 1).second) {
+        unique_.pop_back();
+      }
+    }
+
+    duplicates_.fetch_add(batch_.size() - unique_.size(), std::memory_order_relaxed);
+    if (sink_) {
+      sink_(unique_.data(), unique_.size());
+    }
+    delivered_.fetch_add(unique_.size(), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Number of events handed to the sink
+   */
+  std::uint64_t delivered() const noexcept {
+    return delivered_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Number of events collapsed into an earlier one in the same batch
+   */
+  std::uint64_t duplicates() const noexcept {
+    return duplicates_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Number of events lost because a thread's buffer was full
+   */
+  std::uint64_t dropped() const { return core_->dropped(); }
+};
+
+/**
+ * @brief Make a sink that appends each exposure to a file as a JSON line
+ *
+ * Each line looks like
+ * `{"time_ns":...,"flag":"checkout","key":"user-7","source":"rollout","index":1}`;
+ * index is -1 when the flag's own value was served.
+ *
+ * @param path The file, opened for appending
+ * @return ExposureLog::Sink The sink, or an empty sink if the file could not be opened
+ */
+inline ExposureLog::Sink exposure_file_sink(const std::string& path) {
+  std::shared_ptr<std::FILE> file(std::fopen(path.c_str(), "a"),
+                                  [](std::FILE* f) {
+                                    if (f) {
+                                      std::fclose(f);
+                                    }
+                                  });
+  if (!file) {
+    return {};
+  }
+  return [file, line = std::string()](const Exposure* events,
+                                      std::size_t count) mutable {
+    static const char* const sources[] = {"value", "rollout", "rule"};
+    for (std::size_t i = 0; i < count; ++i) {
+      const Exposure& e = events[i];
+      line = "{\"time_ns\":" + std::to_string(e.time_ns) + ",\"flag\":";
+      detail::exposure::write_json_string(line, e.flag->name());
+      line += ",\"key\":";
+      detail::exposure::write_json_string(line, e.key());
+      line += ",\"source\":\"";
+      line += sources[static_cast<int>(e.source)];
+      line += "\",\"index\":";
+      line += e.index == UINT32_MAX ? std::string("-1") : std::to_string(e.index);
+      line += "}\n";
+      std::fwrite(line.data(), 1, line.size(), file.get());
+    }
+    std::fflush(file.get());
+  };
+}
+
+} // namespace flagpp
+
+#endif // FLAGPP_EXPOSURE_HPP
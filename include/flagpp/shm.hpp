@@ -0,0 +1,633 @@
+/**
+ * @file shm.hpp
+ * @brief One flag table shared by every process on a host
+ *
+ * A single writer process publishes flag values into a fixed-layout table
+ * in POSIX shared memory (/dev/shm). Any number of reader processes map it
+ * read-only and read values with plain loads under a per-slot sequence
+ * counter: a reader never writes to the table and never blocks the writer,
+ * and a value published by the writer is visible to every reader at once.
+ *
+ * Each slot is two cache lines and holds a name of up to 48 bytes and a
+ * bool, int, double or a string of up to 64 bytes. The table's capacity is
+ * fixed when it is created. Publishing a whole registry is bracketed by a
+ * table-wide sequence counter, so SharedFlagReader::apply_to() sees all of
+ * a batch or none of it.
+ *
+ * Everything in the table is treated as untrusted input: sizes are
+ * clamped to the slot, and a reader that keeps finding a slot or batch
+ * mid-write, as it would if the writer died there, gives up and reports
+ * a failed read instead of spinning. Reopening the table with
+ * SharedFlagWriter::create() finishes any write a dead writer left open.
+ *
+ * Requires POSIX and lock-free, address-free std::atomic.
+ */
+
+#ifndef FLAGPP_SHM_HPP
+#define FLAGPP_SHM_HPP
+
+#include <flagpp.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flagpp {
+
+namespace detail {
+
+namespace shm {
+
+constexpr char magic[8] = {'F', 'L', 'A', 'G', 'P', 'P', 'S', 'M'};
+constexpr std::uint32_t format_version = 1;
+constexpr std::size_t name_words = 6;
+constexpr std::size_t text_words = 8;
+constexpr std::size_t max_name_size = name_words * 8;
+constexpr std::size_t max_text_size = text_words * 8;
+constexpr unsigned slot_read_attempts = 1024;   // Reads of one slot before giving up
+constexpr unsigned batch_read_attempts = 65536; // Tries at one batch in apply_to()
+
+using Word = std::atomic<std::uint64_t>;
+
+// Sequence counters are bumped to odd before a write and back to even
+// after it. Words are stored with release and loaded with acquire, so a
+// reader that sees any word of a write also sees the odd counter when it
+// rechecks, and retries. On x86 these are all plain moves.
+
+static_assert(Word::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "shared-memory flags need lock-free atomics");
+
+struct alignas(cache_line_size) Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t capacity; // Slots, a power of two
+  Word sequence;          // Odd while a batch is being published
+  std::atomic<std::uint32_t> ready; // Set once the header is initialised
+};
+
+struct alignas(cache_line_size) Slot {
+  std::atomic<std::uint32_t> sequence; // Odd while the slot is being written
+  std::atomic<std::uint32_t> meta;     // type | name size << 8 | text size << 16
+  Word scalar;                         // bool, int or double bits
+  Word name[name_words];               // Written once, when the slot is claimed
+  Word text[text_words];               // String values
+};
+
+static_assert(sizeof(Header) == 64 && sizeof(Slot) == 128,
+              "shared-memory structures must match the table layout");
+
+inline void store_bytes(Word* words, std::size_t count, std::string_view bytes) {
+  for (std::size_t i = 0; i < count; ++i) {
+    std::uint64_t word = 0;
+    if (i * 8 < bytes.size()) {
+      std::memcpy(&word, bytes.data() + i * 8, std::min<std::size_t>(8, bytes.size() - i * 8));
+    }
+    words[i].store(word, std::memory_order_release);
+  }
+}
+
+// Copies up to `size` bytes, but never more than the `count` words hold;
+// returns the number copied
+inline std::size_t load_bytes(const Word* words, std::size_t count, std::size_t size,
+                              char* out) {
+  size = std::min(size, count * 8);
+  for (std::size_t i = 0; i * 8 < size; ++i) {
+    std::uint64_t word = words[i].load(std::memory_order_acquire);
+    std::memcpy(out + i * 8, &word, std::min<std::size_t>(8, size - i * 8));
+  }
+  return size;
+}
+
+// A slot's contents as read under its sequence counter, with sizes that
+// fit the buffers
+struct Contents {
+  std::uint32_t meta = 0;
+  std::uint64_t scalar = 0;
+  char name[max_name_size];
+  char text[max_text_size];
+
+  std::size_t type() const noexcept { return meta & 0xff; }
+  std::string_view name_view() const noexcept { return {name, (meta >> 8) & 0xff}; }
+
+  FlagValue value() const {
+    switch (type()) {
+    case 0:
+      return scalar != 0;
+    case 1:
+      return static_cast<int>(static_cast<std::int64_t>(scalar));
+    case 2: {
+      double d;
+      std::memcpy(&d, &scalar, sizeof(d));
+      return d;
+    }
+    default:
+      return std::string(text, meta >> 16);
+    }
+  }
+};
+
+/**
+ * @brief Read a slot under its sequence counter
+ * @param slot The slot
+ * @param out Receives the contents
+ * @return bool False if every attempt found the slot mid-write
+ */
+inline bool read_slot(const Slot& slot, Contents& out) {
+  for (unsigned attempt = 0; attempt < slot_read_attempts; ++attempt) {
+    std::uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      std::this_thread::yield(); // The writer is mid-update
+      continue;
+    }
+    std::uint32_t meta = slot.meta.load(std::memory_order_acquire);
+    out.scalar = slot.scalar.load(std::memory_order_acquire);
+    std::size_t name_size = load_bytes(slot.name, name_words, (meta >> 8) & 0xff, out.name);
+    std::size_t text_size =
+        (meta & 0xff) == 3 ? load_bytes(slot.text, text_words, meta >> 16, out.text) : 0;
+    out.meta = (meta & 0xff) | static_cast<std::uint32_t>(name_size) << 8 |
+               static_cast<std::uint32_t>(text_size) << 16;
+    if (slot.sequence.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief A shared-memory mapping of a flag table
+ */
+class Mapping {
+private:
+  void* data_ = MAP_FAILED;
+  std::size_t size_ = 0;
+
+public:
+  Mapping() = default;
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  ~Mapping() { reset(); }
+
+  void reset() {
+    if (data_ != MAP_FAILED) {
+      ::munmap(data_, size_);
+      data_ = MAP_FAILED;
+    }
+  }
+
+  bool map(int fd, std::size_t size, bool writable) {
+    reset();
+    size_ = size;
+    data_ = ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, fd, 0);
+    return data_ != MAP_FAILED;
+  }
+
+  Header* header() const noexcept { return static_cast<Header*>(data_); }
+
+  Slot* slots() const noexcept {
+    return reinterpret_cast<Slot*>(static_cast<char*>(data_) + sizeof(Header));
+  }
+
+  bool mapped() const noexcept { return data_ != MAP_FAILED; }
+};
+
+inline std::size_t table_size(std::size_t capacity) {
+  return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+} // namespace shm
+
+} // namespace detail
+
+/**
+ * @brief Publishes flag values into a shared-memory table
+ *
+ * There must be one writer per table. Its methods may be called from
+ * several threads of the writing process.
+ */
+class SharedFlagWriter {
+private:
+  detail::shm::Mapping mapping_;
+  std::size_t mask_ = 0;
+  std::mutex mutex_;
+
+  // Finds the slot holding a name, claiming an empty one if needed
+  detail::shm::Slot* slot_for(std::string_view name) {
+    namespace shm = detail::shm;
+    std::size_t index = detail::hash_bytes(name) & mask_;
+    char stored[shm::max_name_size];
+    for (std::size_t probe = 0; probe <= mask_; ++probe, index = (index + 1) & mask_) {
+      shm::Slot& slot = mapping_.slots()[index];
+      std::uint32_t meta = slot.meta.load(std::memory_order_relaxed);
+      std::size_t size = (meta >> 8) & 0xff;
+      if (size == 0) {
+        return &slot; // Unclaimed; the caller writes the name
+      }
+      if (size == name.size()) {
+        shm::load_bytes(slot.name, shm::name_words, size, stored);
+        if (std::string_view(stored, size) == name) {
+          return &slot;
+        }
+      }
+    }
+    return nullptr; // Full
+  }
+
+  bool publish_locked(std::string_view name, const FlagValue& value) {
+    namespace shm = detail::shm;
+    const auto* text = std::get_if<std::string>(&value);
+    if (name.empty() || name.size() > shm::max_name_size ||
+        (text && text->size() > shm::max_text_size)) {
+      return false;
+    }
+    shm::Slot* slot = slot_for(name);
+    if (!slot) {
+      return false;
+    }
+
+    std::uint64_t scalar = 0;
+    if (const auto* b = std::get_if<bool>(&value)) {
+      scalar = *b;
+    } else if (const auto* n = std::get_if<int>(&value)) {
+      scalar = static_cast<std::uint64_t>(static_cast<std::int64_t>(*n));
+    } else if (const auto* d = std::get_if<double>(&value)) {
+      std::memcpy(&scalar, d, sizeof(double));
+    }
+    std::uint32_t meta = static_cast<std::uint32_t>(value.index()) |
+                         static_cast<std::uint32_t>(name.size()) << 8 |
+                         static_cast<std::uint32_t>(text ? text->size() : 0) << 16;
+
+    std::uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    if ((slot->meta.load(std::memory_order_relaxed) >> 8 & 0xff) == 0) {
+      shm::store_bytes(slot->name, shm::name_words, name);
+    }
+    slot->scalar.store(scalar, std::memory_order_release);
+    if (text) {
+      shm::store_bytes(slot->text, shm::text_words, *text);
+    }
+    slot->meta.store(meta, std::memory_order_release);
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+  }
+
+public:
+  SharedFlagWriter() = default;
+  SharedFlagWriter(const SharedFlagWriter&) = delete;
+  SharedFlagWriter& operator=(const SharedFlagWriter&) = delete;
+
+  /**
+   * @brief Create a table, or reopen one this writer published before
+   *
+   * Reopening keeps the values already published and the mappings of
+   * running readers, and closes any write a previous writer left open by
+   * dying mid-write. Such a slot keeps whatever that writer stored until
+   * its flag is published again.
+   *
+   * @param name The shared-memory object's name, e.g. "/myapp-flags"
+   * @param capacity Number of slots, rounded up to a power of two; keep it
+   *        well above the number of flags
+   * @return bool False if the table could not be created, or exists with
+   *        another layout
+   */
+  bool create(const std::string& name, std::size_t capacity) {
+    namespace shm = detail::shm;
+    std::size_t slots = 1;
+    while (slots < capacity) {
+      slots <<= 1;
+    }
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0;
+    bool fresh = ok && info.st_size == 0;
+    if (fresh) {
+      ok = ::ftruncate(fd, static_cast<off_t>(shm::table_size(slots))) == 0;
+    } else if (ok) {
+      ok = static_cast<std::size_t>(info.st_size) == shm::table_size(slots);
+    }
+    ok = ok && mapping_.map(fd, shm::table_size(slots), true);
+    ::close(fd);
+    if (!ok) {
+      mapping_.reset();
+      return false;
+    }
+
+    shm::Header* header = mapping_.header();
+    if (fresh || header->ready.load(std::memory_order_acquire) == 0) {
+      std::memcpy(header->magic, shm::magic, sizeof(header->magic));
+      header->version = shm::format_version;
+      header->capacity = static_cast<std::uint32_t>(slots);
+      header->ready.store(1, std::memory_order_release);
+    } else if (std::memcmp(header->magic, shm::magic, sizeof(header->magic)) != 0 ||
+               header->version != shm::format_version || header->capacity != slots) {
+      mapping_.reset();
+      return false;
+    } else {
+      // Odd counters were left by a writer that died mid-write
+      std::uint64_t batch = header->sequence.load(std::memory_order_relaxed);
+      if (batch & 1) {
+        header->sequence.store(batch + 1, std::memory_order_release);
+      }
+      for (std::size_t i = 0; i < slots; ++i) {
+        shm::Slot& slot = mapping_.slots()[i];
+        std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        if (sequence & 1) {
+          slot.sequence.store(sequence + 1, std::memory_order_release);
+        }
+      }
+    }
+    mask_ = slots - 1;
+    return true;
+  }
+
+  /**
+   * @brief Delete a table; mapped readers keep their view until they unmap
+   * @param name The shared-memory object's name
+   * @return bool False if the table did not exist
+   */
+  static bool remove(const std::string& name) { return ::shm_unlink(name.c_str()) == 0; }
+
+  /**
+   * @brief Publish one flag value
+   * @param name The flag's name, at most 48 bytes
+   * @param value The value; strings may be at most 64 bytes
+   * @return bool False if the table is not open or full, or the name or
+   *         value is too long
+   */
+  bool publish(std::string_view name, const FlagValue& value) {
+    if (!mapping_.mapped()) {
+      return false;
+    }
+    std::lock_guard lock(mutex_);
+    return publish_locked(name, value);
+  }
+
+  /**
+   * @brief Publish every flag in a registry as one batch
+   * @param registry The registry
+   * @return std::size_t Number of flags published; the rest did not fit
+   */
+  std::size_t publish(const FlagRegistry& registry) {
+    if (!mapping_.mapped()) {
+      return 0;
+    }
+    std::vector<std::pair<std::shared_ptr<Flag>, FlagValue>> values;
+    for (auto& flag : registry.get_all()) {
+      detail::EpochDomain::Guard guard;
+      FlagValue value = flag->snapshot();
+      values.emplace_back(std::move(flag), std::move(value));
+    }
+
+    std::lock_guard lock(mutex_);
+    detail::shm::Word& sequence = mapping_.header()->sequence;
+    std::uint64_t batch = sequence.load(std::memory_order_relaxed);
+    sequence.store(batch + 1, std::memory_order_relaxed);
+    std::size_t published = 0;
+    for (const auto& [flag, value] : values) {
+      published += publish_locked(flag->name(), value);
+    }
+    sequence.store(batch + 2, std::memory_order_release);
+    return published;
+  }
+};
+
+/**
+ * @brief Reads flag values from a shared-memory table
+ *
+ * Reads are wait-free unless they overlap a write of the same slot, in
+ * which case they retry a bounded number of times and then fail. Look a
+ * name up once with find() and read by slot on hot paths.
+ */
+class SharedFlagReader {
+private:
+  detail::shm::Mapping mapping_;
+  std::size_t mask_ = 0;
+
+public:
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  SharedFlagReader() = default;
+  SharedFlagReader(const SharedFlagReader&) = delete;
+  SharedFlagReader& operator=(const SharedFlagReader&) = delete;
+
+  /**
+   * @brief Map a table read-only
+   * @param name The shared-memory object's name
+   * @return bool False if the table does not exist or is not a flag table
+   */
+  bool open(const std::string& name) {
+    namespace shm = detail::shm;
+    int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0 &&
+              static_cast<std::size_t>(info.st_size) >= sizeof(shm::Header) &&
+              mapping_.map(fd, static_cast<std::size_t>(info.st_size), false);
+    ::close(fd);
+    if (!ok) {
+      mapping_.reset();
+      return false;
+    }
+    // The capacity becomes the probe mask, so it must be a nonzero power
+    // of two as well as match the mapping's size
+    const shm::Header* header = mapping_.header();
+    std::uint32_t capacity = header->capacity;
+    if (header->ready.load(std::memory_order_acquire) == 0 ||
+        std::memcmp(header->magic, shm::magic, sizeof(header->magic)) != 0 ||
+        header->version != shm::format_version ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        shm::table_size(capacity) != static_cast<std::size_t>(info.st_size)) {
+      mapping_.reset();
+      return false;
+    }
+    mask_ = capacity - 1;
+    return true;
+  }
+
+  /**
+   * @brief Find the slot holding a flag
+   * @param name The flag's name
+   * @return std::size_t The slot, valid for the table's lifetime, or npos
+   *         if it is not found or a slot on the way could not be read
+   */
+  std::size_t find(std::string_view name) const {
+    if (!mapping_.mapped()) {
+      return npos;
+    }
+    std::size_t index = detail::hash_bytes(name) & mask_;
+    detail::shm::Contents contents;
+    for (std::size_t probe = 0; probe <= mask_; ++probe, index = (index + 1) & mask_) {
+      if (!detail::shm::read_slot(mapping_.slots()[index], contents) ||
+          contents.name_view().empty()) {
+        return npos;
+      }
+      if (contents.name_view() == name) {
+        return index;
+      }
+    }
+    return npos;
+  }
+
+  /**
+   * @brief Read a scalar flag by slot
+   * @tparam T bool, int or double
+   * @param slot A slot returned by find()
+   * @return T The value, or the type's default if the flag holds another
+   *         type or the slot could not be read
+   */
+  template <typename T>
+  T scalar(std::size_t slot) const noexcept {
+    static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> ||
+                      std::is_same_v<T, double>,
+                  "scalar() supports bool, int and double");
+    const detail::shm::Slot& s = mapping_.slots()[slot];
+    std::uint32_t meta = 0xff; // No type, if every attempt fails
+    std::uint64_t bits = 0;
+    for (unsigned attempt = 0; attempt < detail::shm::slot_read_attempts; ++attempt) {
+      std::uint32_t before = s.sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      std::uint32_t m = s.meta.load(std::memory_order_acquire);
+      std::uint64_t b = s.scalar.load(std::memory_order_acquire);
+      if (s.sequence.load(std::memory_order_relaxed) == before) {
+        meta = m;
+        bits = b;
+        break;
+      }
+    }
+    if constexpr (std::is_same_v<T, bool>) {
+      return (meta & 0xff) == 0 && bits != 0;
+    } else if constexpr (std::is_same_v<T, int>) {
+      return (meta & 0xff) == 1 ? static_cast<int>(static_cast<std::int64_t>(bits)) : 0;
+    } else {
+      double d = 0.0;
+      if ((meta & 0xff) == 2) {
+        std::memcpy(&d, &bits, sizeof(d));
+      }
+      return d;
+    }
+  }
+
+  /**
+   * @brief Read a flag by slot
+   * @param slot A slot returned by find()
+   * @return std::optional<FlagValue> The value, or nullopt if the slot could not be read
+   */
+  std::optional<FlagValue> value(std::size_t slot) const {
+    detail::shm::Contents contents;
+    if (!detail::shm::read_slot(mapping_.slots()[slot], contents)) {
+      return std::nullopt;
+    }
+    return contents.value();
+  }
+
+  /**
+   * @brief Read a flag by name
+   * @param name The flag's name
+   * @return std::optional<FlagValue> The value, or nullopt if the table has no
+   *         such flag or it could not be read
+   */
+  std::optional<FlagValue> get(std::string_view name) const {
+    std::size_t slot = find(name);
+    return slot == npos ? std::nullopt : value(slot);
+  }
+
+  /**
+   * @brief Check if a boolean flag is enabled
+   * @param name The flag's name
+   * @return bool True if the flag exists and is enabled, false otherwise
+   */
+  bool is_enabled(std::string_view name) const {
+    std::size_t slot = find(name);
+    return slot != npos && scalar<bool>(slot);
+  }
+
+  /**
+   * @brief Get a flag's value with type checking
+   * @tparam T The expected type of the flag's value
+   * @param name The flag's name
+   * @return std::optional<T> The value if the flag exists and matches the type, or nullopt
+   */
+  template <typename T>
+  std::optional<T> get_value(std::string_view name) const {
+    std::optional<FlagValue> value = get(name);
+    const T* typed = value ? std::get_if<T>(&*value) : nullptr;
+    return typed ? std::optional<T>(*typed) : std::nullopt;
+  }
+
+  /**
+   * @brief Copy every flag in the table into a local registry
+   *
+   * The table is read as of one published batch. Flags the registry lacks
+   * are added; the values of the others are applied as one Transaction.
+   * Nothing is applied if the table stays mid-write.
+   *
+   * @param registry The registry
+   * @return std::size_t Number of flags added or changed
+   */
+  std::size_t apply_to(FlagRegistry& registry) const {
+    namespace shm = detail::shm;
+    if (!mapping_.mapped()) {
+      return 0;
+    }
+    std::vector<std::pair<std::string, FlagValue>> values;
+    const shm::Word& sequence = mapping_.header()->sequence;
+    shm::Contents contents;
+    bool consistent = false;
+    for (unsigned attempt = 0; attempt < shm::batch_read_attempts && !consistent;
+         ++attempt) {
+      std::uint64_t before = sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield(); // A batch is being published
+        continue;
+      }
+      values.clear();
+      bool read = true;
+      for (std::size_t i = 0; i <= mask_ && read; ++i) {
+        read = shm::read_slot(mapping_.slots()[i], contents);
+        if (read && !contents.name_view().empty()) {
+          values.emplace_back(std::string(contents.name_view()), contents.value());
+        }
+      }
+      if (!read) {
+        return 0; // A slot stayed mid-write
+      }
+      consistent = sequence.load(std::memory_order_relaxed) == before;
+    }
+    if (!consistent) {
+      return 0;
+    }
+
+    std::size_t added = 0;
+    for (const auto& [name, value] : values) {
+      if (!registry.exists(name)) {
+        added += registry.insert(std::make_shared<Flag>(name, value));
+      }
+    }
+    return added + registry.apply(values);
+  }
+};
+
+} // namespace flagpp
+
+#endif // FLAGPP_SHM_HPP
@@ -0,0 +1,407 @@
+/**
+ * @file snapshot.hpp
+ * @brief Binary registry snapshots that load with a single mmap
+ *
+ * A snapshot holds every flag's name, description and current value. It
+ * is written once, for example at build or deploy time, and mapped back
+ * at startup: loading validates the file and attaches it to the registry
+ * as a FlagSource, and each flag is constructed from its record the first
+ * time it is looked up, with its name and description viewed in place in
+ * the mapping. The mapping stays alive for as long as any flag loaded
+ * from it does. Rollouts and rules are not included.
+ *
+ * Layout, little-endian: a 32-byte header, one 32-byte record per flag,
+ * an open-addressing index of 32-bit record numbers (plus one; zero is
+ * empty) probed linearly from detail::hash_bytes of the name, then a pool
+ * of every name, description and string value. The index has the
+ * smallest power-of-two slot count at least twice the flag count. The
+ * header's checksum is detail::hash_bytes over everything after the
+ * header.
+ *
+ * Requires POSIX.
+ */
+
+#ifndef FLAGPP_SNAPSHOT_HPP
+#define FLAGPP_SNAPSHOT_HPP
+
+#include <flagpp.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flagpp {
+
+namespace detail {
+
+namespace snapshot {
+
+constexpr char magic[8] = {'F', 'L', 'A', 'G', 'P', 'P', 'S', 'N'};
+constexpr std::uint32_t format_version = 2;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t flag_count;
+  std::uint64_t payload_size; // Records, index and pool
+  std::uint64_t checksum;
+};
+
+struct Record {
+  std::uint32_t name_offset; // Offsets are into the pool
+  std::uint32_t name_size;
+  std::uint32_t description_offset;
+  std::uint32_t description_size;
+  std::uint32_t type; // FlagValue index
+  std::uint32_t reserved;
+  std::uint64_t value; // Integer, double bits, or string offset << 32 | size
+};
+
+static_assert(sizeof(Header) == 32 && sizeof(Record) == 32,
+              "snapshot structures must match the file layout");
+
+inline std::size_t index_slots(std::size_t count) {
+  std::size_t slots = 1;
+  while (slots < 2 * count) {
+    slots <<= 1;
+  }
+  return slots;
+}
+
+/**
+ * @brief A validated snapshot file, serving its flags on first lookup
+ *
+ * Flags are constructed in place in one block, sized for every record up
+ * front but only touched as flags are made, and each is handed out as an
+ * aliasing pointer that keeps the whole mapping alive.
+ */
+class Mapping final : public FlagSource,
+                      public std::enable_shared_from_this<Mapping> {
+private:
+  void* data_ = MAP_FAILED;
+  std::size_t size_ = 0;
+  const char* records_ = nullptr;
+  const char* index_ = nullptr;
+  std::size_t index_mask_ = 0;
+  const char* pool_ = nullptr;
+  std::uint64_t pool_size_ = 0;
+  std::uint32_t count_ = 0;
+  Flag* flags_ = nullptr;
+  std::unique_ptr<bool[]> constructed_; // Written under the name's shard lock
+
+  Record record(std::size_t i) const {
+    Record record;
+    std::memcpy(&record, records_ + i * sizeof(Record), sizeof(record));
+    return record;
+  }
+
+  bool text(std::uint64_t offset, std::uint64_t size, std::string_view& out) const {
+    if (offset > pool_size_ || size > pool_size_ - offset) {
+      return false;
+    }
+    out = std::string_view(pool_ + offset, size);
+    return true;
+  }
+
+  // Decodes a record's value; false if the record is malformed
+  bool decode(const Record& record, FlagValue& value) const {
+    switch (record.type) {
+    case 0:
+      value = record.value != 0;
+      return true;
+    case 1:
+      value = static_cast<int>(static_cast<std::int64_t>(record.value));
+      return true;
+    case 2: {
+      double d;
+      std::memcpy(&d, &record.value, sizeof(d));
+      value = d;
+      return true;
+    }
+    case 3: {
+      std::string_view string_value;
+      if (!text(record.value >> 32, record.value & 0xffffffffULL, string_value)) {
+        return false;
+      }
+      value = std::string(string_value);
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  // Returns the record holding a name, or count_ if there is none
+  std::size_t find(const HashedName& key) const {
+    std::size_t slot = key.hash & index_mask_;
+    for (std::size_t probe = 0; probe <= index_mask_; ++probe) {
+      std::uint32_t entry;
+      std::memcpy(&entry, index_ + slot * sizeof(entry), sizeof(entry));
+      if (entry == 0 || entry > count_) {
+        break;
+      }
+      Record candidate = record(entry - 1);
+      std::string_view name;
+      if (text(candidate.name_offset, candidate.name_size, name) && name == key.name) {
+        return entry - 1;
+      }
+      slot = (slot + 1) & index_mask_;
+    }
+    return count_;
+  }
+
+public:
+  Mapping() = default;
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  ~Mapping() override {
+    for (std::size_t i = 0; i < count_ && flags_; ++i) {
+      if (constructed_[i]) {
+        flags_[i].~Flag();
+      }
+    }
+    if (flags_) {
+      std::allocator<Flag>().deallocate(flags_, count_);
+    }
+    if (data_ != MAP_FAILED) {
+      ::munmap(data_, size_);
+    }
+  }
+
+  /**
+   * @brief Map a snapshot file and check its header and checksum
+   *
+   * Records are checked as their flags are made; with a valid checksum
+   * they can only be malformed if the writer was.
+   *
+   * @param path The snapshot file
+   * @return bool False if the file is missing or invalid
+   */
+  bool open(const char* path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      size_ = static_cast<std::size_t>(info.st_size);
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data_ == MAP_FAILED || size_ < sizeof(Header)) {
+      return false;
+    }
+
+    const char* data = static_cast<const char*>(data_);
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    const char* payload = data + sizeof(header);
+    const std::uint64_t records_size = std::uint64_t{header.flag_count} * sizeof(Record);
+    const std::uint64_t index_size =
+        std::uint64_t{index_slots(header.flag_count)} * sizeof(std::uint32_t);
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+        header.version != format_version ||
+        header.payload_size != size_ - sizeof(header) ||
+        records_size + index_size > header.payload_size ||
+        header.checksum !=
+            hash_bytes(std::string_view(payload, header.payload_size))) {
+      return false;
+    }
+
+    records_ = payload;
+    index_ = payload + records_size;
+    index_mask_ = index_slots(header.flag_count) - 1;
+    pool_ = index_ + index_size;
+    pool_size_ = header.payload_size - records_size - index_size;
+    count_ = header.flag_count;
+    if (count_ > 0) {
+      flags_ = std::allocator<Flag>().allocate(count_);
+      constructed_ = std::make_unique<bool[]>(count_);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read the value a flag has in the snapshot
+   * @param key The flag's name and hash
+   * @param value Set to the value
+   * @return bool False if the snapshot has no such flag
+   */
+  bool value_of(const HashedName& key, FlagValue& value) const {
+    std::size_t i = find(key);
+    return i < count_ && decode(record(i), value);
+  }
+
+  std::shared_ptr<Flag> make(const HashedName& key) const override {
+    std::size_t i = find(key);
+    if (i == count_) {
+      return nullptr;
+    }
+    if (!constructed_[i]) {
+      Record r = record(i);
+      std::string_view name, description;
+      FlagValue value;
+      if (!text(r.name_offset, r.name_size, name) ||
+          !text(r.description_offset, r.description_size, description) ||
+          !decode(r, value)) {
+        return nullptr;
+      }
+      new (flags_ + i) Flag(Flag::Borrowed{}, name, std::move(value), description);
+      constructed_[i] = true;
+    }
+    // Aliasing pointers share the mapping's lifetime
+    return std::shared_ptr<Flag>(shared_from_this(), flags_ + i);
+  }
+
+  void for_each_name(const std::function<void(std::string_view)>& fn) const override {
+    for (std::size_t i = 0; i < count_; ++i) {
+      Record r = record(i);
+      std::string_view name;
+      if (text(r.name_offset, r.name_size, name)) {
+        fn(name);
+      }
+    }
+  }
+};
+
+} // namespace snapshot
+
+} // namespace detail
+
+/**
+ * @brief Write every flag in a registry to a snapshot file
+ *
+ * The file is written beside the target and renamed over it, so readers
+ * never observe a partial snapshot.
+ *
+ * @param registry The registry to save
+ * @param path The snapshot file
+ * @return bool False if the file could not be written
+ */
+inline bool save_snapshot(const FlagRegistry& registry, const std::string& path) {
+  namespace fmt = detail::snapshot;
+
+  std::vector<std::shared_ptr<Flag>> flags = registry.get_all();
+  std::vector<fmt::Record> records(flags.size());
+  std::string pool;
+  auto append = [&pool](std::string_view text) {
+    auto offset = static_cast<std::uint32_t>(pool.size());
+    pool.append(text.data(), text.size());
+    return offset;
+  };
+
+  {
+    detail::EpochDomain::Guard guard;
+    for (std::size_t i = 0; i < flags.size(); ++i) {
+      fmt::Record& record = records[i];
+      record.name_size = static_cast<std::uint32_t>(flags[i]->name().size());
+      record.name_offset = append(flags[i]->name());
+      record.description_size =
+          static_cast<std::uint32_t>(flags[i]->description().size());
+      record.description_offset = append(flags[i]->description());
+
+      const FlagValue& value = flags[i]->snapshot();
+      record.type = static_cast<std::uint32_t>(value.index());
+      if (const auto* b = std::get_if<bool>(&value)) {
+        record.value = *b;
+      } else if (const auto* n = std::get_if<int>(&value)) {
+        record.value = static_cast<std::uint64_t>(static_cast<std::int64_t>(*n));
+      } else if (const auto* d = std::get_if<double>(&value)) {
+        std::memcpy(&record.value, d, sizeof(double));
+      } else {
+        const auto& text = std::get<std::string>(value);
+        record.value = std::uint64_t{append(text)} << 32 | text.size();
+      }
+    }
+  }
+
+  std::vector<std::uint32_t> index(fmt::index_slots(records.size()), 0);
+  const std::size_t mask = index.size() - 1;
+  for (std::size_t i = 0; i < flags.size(); ++i) {
+    std::size_t slot = detail::hash_bytes(flags[i]->name()) & mask;
+    while (index[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    index[slot] = static_cast<std::uint32_t>(i + 1);
+  }
+
+  const std::size_t records_size = records.size() * sizeof(fmt::Record);
+  const std::size_t index_size = index.size() * sizeof(std::uint32_t);
+  std::string payload(records_size + index_size, '\0');
+  if (!records.empty()) {
+    std::memcpy(payload.data(), records.data(), records_size);
+  }
+  std::memcpy(payload.data() + records_size, index.data(), index_size);
+  payload += pool;
+
+  fmt::Header header{};
+  std::memcpy(header.magic, fmt::magic, sizeof(header.magic));
+  header.version = fmt::format_version;
+  header.flag_count = static_cast<std::uint32_t>(records.size());
+  header.payload_size = payload.size();
+  header.checksum = detail::hash_bytes(payload);
+
+  std::string temporary = path + ".tmp";
+  std::FILE* out = std::fopen(temporary.c_str(), "wb");
+  if (!out) {
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+            std::fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+  ok = std::fclose(out) == 0 && ok;
+  if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Map a snapshot file and serve its flags from a registry
+ *
+ * Loading maps the file and verifies its checksum; nothing else is read
+ * until a flag is looked up, when it is constructed from its record.
+ * Flags the registry already has, including those of snapshots loaded
+ * earlier, are updated to the snapshot's value as one transaction. A
+ * frozen registry only takes those updates. Nothing is changed if the
+ * file is missing, truncated, from another format version or fails its
+ * checksum.
+ *
+ * @param registry The registry to load into
+ * @param path The snapshot file
+ * @return bool False if the file could not be mapped or is invalid
+ */
+inline bool load_snapshot(FlagRegistry& registry, const std::string& path) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  return false; // The format is little-endian
+#endif
+
+  auto mapping = std::make_shared<detail::snapshot::Mapping>();
+  if (!mapping->open(path.c_str())) {
+    return false;
+  }
+
+  std::vector<std::pair<std::string, FlagValue>> changes;
+  for (const auto& flag : registry.get_all()) {
+    FlagValue value;
+    if (mapping->value_of(detail::HashedName(flag->name()), value)) {
+      changes.emplace_back(std::string(flag->name()), std::move(value));
+    }
+  }
+  registry.attach(mapping);
+  registry.apply(changes);
+  return true;
+}
+
+} // namespace flagpp
+
+#endif // FLAGPP_SNAPSHOT_HPP
@@ -0,0 +1,306 @@
+/**
+ * @file watcher.hpp
+ * @brief Hot reload of flag values from a watched file
+ *
+ * FileWatcher follows a flag file with inotify and, whenever it is
+ * rewritten or replaced by an atomic rename, parses it on its own thread
+ * and commits the values that changed to a registry as one Transaction.
+ * Readers are never blocked and flags whose value is unchanged are not
+ * touched. Only Snapshot reads see a reload all at once: plain reads of
+ * single flags, such as get_value() or TypedFlag::load(), can see some of
+ * its values before the rest.
+ *
+ * The file holds one `name = value` assignment per line. Blank lines and
+ * lines starting with '#' are ignored. Each value is parsed as the type
+ * the flag already has: true/false, an integer, a number, or a string that
+ * may be wrapped in double quotes.
+ *
+ * FileWatcher requires Linux and is not declared elsewhere; apply_config()
+ * is portable.
+ */
+
+#ifndef FLAGPP_WATCHER_HPP
+#define FLAGPP_WATCHER_HPP
+
+#include <flagpp.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace flagpp {
+
+namespace detail {
+
+inline std::string_view trim(std::string_view text) {
+  const char* space = " \t\r";
+  std::size_t begin = text.find_first_not_of(space);
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  return text.substr(begin, text.find_last_not_of(space) - begin + 1);
+}
+
+/**
+ * @brief Parse text as a value of the same type as another value
+ * @param text The text to parse, trimmed
+ * @param like A value of the target type
+ * @param out Receives the parsed value
+ * @return bool False if the text is not a valid value of that type
+ */
+inline bool parse_as(std::string_view text, const FlagValue& like, FlagValue& out) {
+  std::string owned(text);
+  char* end = nullptr;
+  errno = 0;
+  switch (like.index()) {
+  case 0:
+    if (text != "true" && text != "false") {
+      return false;
+    }
+    out = text == "true";
+    return true;
+  case 1: {
+    long value = std::strtol(owned.c_str(), &end, 10);
+    if (owned.empty() || *end != '\0' || errno != 0 ||
+        value != static_cast<int>(value)) {
+      return false;
+    }
+    out = static_cast<int>(value);
+    return true;
+  }
+  case 2: {
+    double value = std::strtod(owned.c_str(), &end);
+    if (owned.empty() || *end != '\0' || errno != 0) {
+      return false;
+    }
+    out = value;
+    return true;
+  }
+  default:
+    if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+      text = text.substr(1, text.size() - 2);
+    }
+    out = std::string(text);
+    return true;
+  }
+}
+
+} // namespace detail
+
+/**
+ * @brief Parse flag assignments and apply the changed ones to a registry
+ *
+ * The whole text is parsed before anything is applied, so a malformed
+ * line leaves every flag as it was. Names the registry does not know are
+ * skipped.
+ *
+ * @param registry The registry to update
+ * @param text The assignments
+ * @param changed Receives the number of flags whose value changed (optional)
+ * @return bool False if the text is malformed
+ */
+inline bool apply_config(FlagRegistry& registry, std::string_view text,
+                         std::size_t* changed = nullptr) {
+  std::vector<std::pair<std::string, FlagValue>> changes;
+  while (!text.empty()) {
+    std::size_t newline = text.find('\n');
+    std::string_view line = detail::trim(text.substr(0, newline));
+    text = newline == std::string_view::npos ? std::string_view()
+                                             : text.substr(newline + 1);
+    if (line.empty() || line.front() == '#') {
+      continue;
+    }
+
+    std::size_t equals = line.find('=');
+    if (equals == std::string_view::npos) {
+      return false;
+    }
+    std::string_view name = detail::trim(line.substr(0, equals));
+    if (name.empty()) {
+      return false;
+    }
+    auto flag = registry.get(name);
+    if (!flag) {
+      continue;
+    }
+
+    FlagValue like;
+    {
+      detail::EpochDomain::Guard guard;
+      like = flag->snapshot();
+    }
+    FlagValue value;
+    if (!detail::parse_as(detail::trim(line.substr(equals + 1)), like, value)) {
+      return false;
+    }
+    changes.emplace_back(std::string(name), std::move(value));
+  }
+
+  std::size_t count = registry.apply(changes);
+  if (changed) {
+    *changed = count;
+  }
+  return true;
+}
+
+#if defined(__linux__)
+
+/**
+ * @brief Reloads a flag file into a registry whenever it changes
+ *
+ * The containing directory is watched rather than the file itself, so
+ * replacing the file with an atomic rename is picked up like an in-place
+ * rewrite. Parsing and applying happen on the watcher's thread.
+ */
+class FileWatcher {
+private:
+  FlagRegistry& registry_;
+  std::string path_;
+  std::string directory_;
+  std::string file_name_;
+  int inotify_fd_ = -1;
+  int stop_fd_ = -1;
+  std::thread thread_;
+  std::atomic<std::uint64_t> reloads_{0};
+  std::atomic<std::uint64_t> failures_{0};
+
+  void reload() {
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) {
+      failures_.fetch_add(1, std::memory_order_release);
+      return;
+    }
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    if (apply_config(registry_, contents.str())) {
+      reloads_.fetch_add(1, std::memory_order_release);
+    } else {
+      failures_.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  void run() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    for (;;) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[1].revents) {
+        return;
+      }
+
+      // Coalesce every event already queued into at most one reload. If
+      // the kernel queue overflowed, events for the file may have been
+      // dropped, so reload to be safe
+      bool changed = false;
+      ssize_t length;
+      while ((length = ::read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+        for (char* at = buffer; at < buffer + length;) {
+          auto* event = reinterpret_cast<inotify_event*>(at);
+          changed |= (event->mask & IN_Q_OVERFLOW) != 0 ||
+                     (event->len > 0 && file_name_ == event->name);
+          at += sizeof(inotify_event) + event->len;
+        }
+      }
+      if (changed) {
+        reload();
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief Construct a watcher; call start() to begin watching
+   * @param registry The registry to update
+   * @param path The flag file
+   */
+  FileWatcher(FlagRegistry& registry, std::string path)
+      : registry_(registry), path_(std::move(path)) {
+    std::size_t slash = path_.rfind('/');
+    directory_ = slash == std::string::npos ? "." : path_.substr(0, slash + 1);
+    file_name_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+  }
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  ~FileWatcher() { stop(); }
+
+  /**
+   * @brief Load the file if it exists, then watch it for changes
+   * @return bool False if watching could not be set up
+   */
+  bool start() {
+    if (thread_.joinable()) {
+      return true;
+    }
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0 ||
+        ::inotify_add_watch(inotify_fd_, directory_.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      stop();
+      return false;
+    }
+    if (std::ifstream(path_)) {
+      reload();
+    }
+    thread_ = std::thread([this] { run(); });
+    return true;
+  }
+
+  /**
+   * @brief Stop watching; the registry keeps the last applied values
+   */
+  void stop() {
+    if (thread_.joinable()) {
+      std::uint64_t one = 1;
+      (void)::write(stop_fd_, &one, sizeof(one));
+      thread_.join();
+    }
+    for (int* fd : {&inotify_fd_, &stop_fd_}) {
+      if (*fd >= 0) {
+        ::close(*fd);
+        *fd = -1;
+      }
+    }
+  }
+
+  /**
+   * @brief Number of times the file was read and applied
+   */
+  std::uint64_t reloads() const noexcept {
+    return reloads_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Number of times the file was unreadable or malformed
+   */
+  std::uint64_t failures() const noexcept {
+    return failures_.load(std::memory_order_acquire);
+  }
+};
+
+#endif
+
+} // namespace flagpp
+
+#endif // FLAGPP_WATCHER_HPP
@@ -0,0 +1,98 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+#include "flagpp.hpp"
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Fire-and-forget coroutine, started eagerly and destroyed on completion
+struct Task {
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Queues handles until the test runs them
+struct QueueExecutor {
+  std::mutex* mutex;
+  std::vector<std::coroutine_handle<>>* queue;
+
+  void operator()(std::coroutine_handle<> handle) const {
+    std::lock_guard<std::mutex> lock(*mutex);
+    queue->push_back(handle);
+  }
+};
+
+Task wait_once(const flagpp::Flag& flag, QueueExecutor executor, int& seen) {
+  co_await flag.changed(executor);
+  seen = static_cast<int>(flag.value());
+}
+
+Task wait_inline(const flagpp::Flag& flag, int rounds, std::atomic<int>& done) {
+  for (int i = 0; i < rounds; ++i) {
+    co_await flag.changed();
+  }
+  done.fetch_add(1);
+}
+
+} // namespace
+
+TEST_CASE("Coroutines await flag changes") {
+  SUBCASE("Waiters resume on the executor after an update") {
+    flagpp::Flag flag("coro_limit", 1, "");
+    std::mutex mutex;
+    std::vector<std::coroutine_handle<>> queue;
+    std::vector<int> seen(1000, 0);
+    for (int& slot : seen) {
+      wait_once(flag, QueueExecutor{&mutex, &queue}, slot);
+    }
+    CHECK(queue.empty());
+
+    flag.update(7);
+    REQUIRE(queue.size() == seen.size());
+    for (auto handle : queue) {
+      handle.resume();
+    }
+    for (int value : seen) {
+      CHECK(value == 7);
+    }
+  }
+
+  SUBCASE("A change before suspending is not missed") {
+    flagpp::Flag flag("coro_ready", false, "");
+    auto awaiter = flag.changed();
+    CHECK_FALSE(awaiter.await_ready());
+    flag.update(true);
+    CHECK(awaiter.await_ready());
+  }
+
+  SUBCASE("Concurrent updates resume every waiter") {
+    flagpp::Flag flag("coro_race", 0, "");
+    constexpr int kWaiters = 64;
+    std::atomic<int> done{0};
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+      for (int i = 1; !stop.load(); ++i) {
+        flag.update(i);
+        std::this_thread::yield();
+      }
+    });
+    for (int i = 0; i < kWaiters; ++i) {
+      wait_inline(flag, 3, done);
+    }
+    while (done.load() < kWaiters) {
+      std::this_thread::yield();
+    }
+    stop.store(true);
+    writer.join();
+    CHECK(done.load() == kWaiters);
+  }
+}
@@ -1,8 +1,46 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "flagpp.hpp"
+#include "flagpp/bulk.hpp"
+#include "flagpp/exposure.hpp"
+#include "flagpp/shm.hpp"
+#include "flagpp/snapshot.hpp"
+#include "flagpp/watcher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+FLAGPP_DEFINE_BOOL(static_dark_mode, false, "Statically declared flag");
+FLAGPP_DEFINE_STRING(static_endpoint, "https://api.example.com", "Static URL");
+FLAGPP_DECLARE_INT(static_retries); // Defined in test_static_flags.cpp
+
+std::string static_endpoint_from_other_unit();
+
+namespace {
+
+// Polls a condition that another thread makes true, for up to five seconds
+template <typename Done>
+bool wait_for(Done done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return done();
+}
+
+} // namespace
 
 TEST_CASE("Flag creation and retrieval") {
   // Clear any existing flags from other tests
@@ -230,3 +268,1155 @@ TEST_CASE("Thread safety") {
   // If we got here without crashes or deadlocks, the test passes
   CHECK(true);
 }
+
+TEST_CASE("Snapshot reads during concurrent updates") {
+  flagpp::Flag flag("snapshot_string", std::string("value_0"));
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&]() {
+      while (!done.load(std::memory_order_relaxed)) {
+        auto value = flag.value().get<std::string>();
+        if (!value || value->rfind("value_", 0) != 0) {
+          torn.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+
+  for (int j = 1; j <= 2000; ++j) {
+    flag.update(std::string("value_") + std::to_string(j));
+  }
+  done.store(true, std::memory_order_relaxed);
+
+  for (auto& t : readers) {
+    t.join();
+  }
+
+  CHECK(torn.load() == 0);
+  CHECK(*flag.value().get<std::string>() == "value_2000");
+
+  flag.update(7);
+  CHECK(static_cast<int>(flag.value()) == 7);
+}
+
+TEST_CASE("Typed flag handles") {
+  SUBCASE("Handles are typed after the default value") {
+    flagpp::BoolFlag b = flagpp::flags::define("handle_bool", true);
+    flagpp::IntFlag i = flagpp::flags::define("handle_int", 7);
+    flagpp::DoubleFlag d = flagpp::flags::define("handle_double", 0.5);
+    flagpp::StringFlag s = flagpp::flags::define("handle_string", "text");
+
+    CHECK(b.load() == true);
+    CHECK(i.load() == 7);
+    CHECK(d.load() == doctest::Approx(0.5));
+    CHECK(s.load() == "text");
+    CHECK(flagpp::flags::get_value<std::string>("handle_string") == "text");
+  }
+
+  SUBCASE("Handles observe updates made by name") {
+    auto handle = flagpp::flags::define("handle_update", 1);
+    flagpp::flags::update("handle_update", 2);
+    CHECK(handle.load() == 2);
+
+    handle.update(3);
+    CHECK(*flagpp::flags::get_value<int>("handle_update") == 3);
+  }
+
+  SUBCASE("Type changes read as the type's default") {
+    auto handle = flagpp::flags::define("handle_retyped", true);
+    flagpp::flags::update("handle_retyped", std::string("on"));
+    CHECK(handle.load() == false);
+    CHECK(static_cast<bool>(handle->value()) == false);
+  }
+
+  SUBCASE("Lookup by name") {
+    flagpp::flags::define("handle_lookup", 2.5);
+    CHECK(flagpp::flags::handle<double>("handle_lookup").load() ==
+          doctest::Approx(2.5));
+    CHECK(flagpp::flags::handle<bool>("handle_missing") == nullptr);
+  }
+}
+
+TEST_CASE("Lookup by string_view") {
+  flagpp::flags::define("view_lookup_flag_with_a_long_name", 5);
+
+  std::string_view buffer = "view_lookup_flag_with_a_long_name/suffix";
+  std::string_view name = buffer.substr(0, buffer.find('/'));
+
+  CHECK(flagpp::flags::exists(name));
+  CHECK(flagpp::flags::get(name) != nullptr);
+  CHECK(*flagpp::flags::get_value<int>(name) == 5);
+  CHECK(flagpp::flags::update(name, 6));
+  CHECK(*flagpp::flags::get_value<int>(std::string(name)) == 6);
+  CHECK_FALSE(flagpp::flags::exists(buffer));
+}
+
+TEST_CASE("Sharded registry") {
+  flagpp::FlagRegistry registry(flagpp::RegistryOptions{6});
+  CHECK(registry.shard_count() == 8);
+
+  for (int i = 0; i < 100; ++i) {
+    registry.define("sharded_" + std::to_string(i), i);
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    auto flag = registry.get("sharded_" + std::to_string(i));
+    REQUIRE(flag != nullptr);
+    CHECK(static_cast<int>(flag->value()) == i);
+  }
+
+  CHECK(registry.update("sharded_42", 420));
+  CHECK(registry.handle<int>("sharded_42").load() == 420);
+  CHECK_FALSE(registry.exists("sharded_100"));
+  CHECK(registry.get_all().size() == 100);
+}
+
+TEST_CASE("Frozen registry") {
+  flagpp::FlagRegistry registry(flagpp::RegistryOptions{4});
+  for (int i = 0; i < 1000; ++i) {
+    registry.define("frozen_" + std::to_string(i), i);
+  }
+
+  REQUIRE(registry.freeze());
+  CHECK(registry.is_frozen());
+
+  for (int i = 0; i < 1000; ++i) {
+    auto flag = registry.get("frozen_" + std::to_string(i));
+    REQUIRE(flag != nullptr);
+    CHECK(flag->name() == "frozen_" + std::to_string(i));
+  }
+  CHECK_FALSE(registry.exists("frozen_1000"));
+  CHECK(registry.get_all().size() == 1000);
+
+  SUBCASE("New names are rejected") {
+    CHECK(registry.define("frozen_new", true) == nullptr);
+    CHECK_FALSE(registry.exists("frozen_new"));
+  }
+
+  SUBCASE("Existing names and updates still work") {
+    CHECK(registry.define("frozen_7", 0).load() == 7);
+    CHECK(registry.update("frozen_7", 70));
+    CHECK(registry.handle<int>("frozen_7").load() == 70);
+  }
+
+  SUBCASE("Empty registry") {
+    flagpp::FlagRegistry empty;
+    CHECK(empty.freeze());
+    CHECK(empty.get("anything") == nullptr);
+  }
+}
+
+TEST_CASE("Static flag declarations") {
+  static_assert(flagpp::detail::HashedName("static_dark_mode").hash ==
+                    flagpp::detail::hash_bytes("static_dark_mode"),
+                "name hashes are computed at compile time");
+
+  CHECK(FLAGPP_static_dark_mode.load() == false);
+  CHECK(FLAGPP_static_dark_mode->description() == "Statically declared flag");
+  CHECK(FLAGPP_static_endpoint.load() == "https://api.example.com");
+
+  REQUIRE(flagpp::flags::exists("static_dark_mode"));
+  CHECK(flagpp::flags::get("static_dark_mode").get() ==
+        FLAGPP_static_dark_mode.operator->());
+
+  flagpp::flags::update("static_dark_mode", true);
+  CHECK(FLAGPP_static_dark_mode.load() == true);
+
+  FLAGPP_static_dark_mode.update(false);
+  CHECK_FALSE(flagpp::flags::is_enabled("static_dark_mode"));
+
+  // Flags are shared across translation units in both directions
+  CHECK(FLAGPP_static_retries.load() == 3);
+  CHECK(FLAGPP_static_retries->description() == "Defined in another unit");
+  CHECK(static_endpoint_from_other_unit() == "https://api.example.com");
+}
+
+TEST_CASE("Thread-local flag cache") {
+  flagpp::flags::define("cache_bool", false);
+  flagpp::flags::define("cache_int", 1);
+
+  auto& cache = flagpp::flags::local_cache();
+  CHECK_FALSE(cache.is_enabled("cache_bool"));
+  CHECK(cache.get_value<int>("cache_int") == 1);
+  CHECK_FALSE(cache.get_value<bool>("cache_int").has_value());
+  CHECK_FALSE(cache.get_value<int>("cache_missing").has_value());
+
+  flagpp::flags::update("cache_bool", true);
+  flagpp::flags::update("cache_int", 2);
+  CHECK(cache.is_enabled("cache_bool"));
+  CHECK(cache.get_value<int>("cache_int") == 2);
+
+  flagpp::flags::define("cache_missing", 3);
+  CHECK(cache.get_value<int>("cache_missing") == 3);
+
+  std::thread([]() {
+    CHECK(flagpp::flags::local_cache().get_value<int>("cache_int") == 2);
+  }).join();
+}
+
+TEST_CASE("Zero-copy string reads") {
+  auto endpoint = flagpp::flags::define("ref_endpoint", "https://a.example.com");
+
+  SUBCASE("References outlive updates") {
+    flagpp::StringRef before = flagpp::flags::get_string_ref("ref_endpoint");
+    REQUIRE(before);
+    endpoint.update("https://b.example.com");
+
+    CHECK(before.view() == "https://a.example.com");
+    CHECK(endpoint.load_ref().view() == "https://b.example.com");
+
+    flagpp::StringRef copy = before;
+    before = flagpp::StringRef();
+    CHECK(copy.view() == "https://a.example.com");
+  }
+
+  SUBCASE("Non-string flags give an empty reference") {
+    flagpp::flags::define("ref_int", 1);
+    CHECK_FALSE(flagpp::flags::get_string_ref("ref_int"));
+    CHECK_FALSE(flagpp::flags::get_string_ref("ref_missing"));
+  }
+
+  SUBCASE("Concurrent readers and writers") {
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+      readers.emplace_back([&]() {
+        while (!done.load(std::memory_order_relaxed)) {
+          flagpp::StringRef ref = endpoint.load_ref();
+          std::string_view view = ref;
+          if (view.substr(0, 8) != "https://" ||
+              view.substr(view.size() - 12) != ".example.com") {
+            bad.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      });
+    }
+    for (int j = 0; j < 2000; ++j) {
+      endpoint.update("https://host" + std::to_string(j) + ".example.com");
+    }
+    done.store(true, std::memory_order_relaxed);
+    for (auto& t : readers) {
+      t.join();
+    }
+    CHECK(bad.load() == 0);
+  }
+}
+
+TEST_CASE("Percentage rollouts") {
+  static_assert(flagpp::detail::hash_u64(0x0807060504030201ULL, 9) ==
+                    flagpp::detail::hash_bytes("\x01\x02\x03\x04\x05\x06\x07\x08", 9),
+                "numeric keys hash as their little-endian bytes");
+
+  SUBCASE("On/off rollout selects roughly the requested share") {
+    auto flag = flagpp::flags::define_rollout(
+        "rollout_half", false, flagpp::Rollout::percentage(50.0, 1));
+    int enabled = 0;
+    for (int i = 0; i < 10000; ++i) {
+      enabled += flag.is_enabled("user-" + std::to_string(i));
+    }
+    CHECK(enabled > 4500);
+    CHECK(enabled < 5500);
+
+    CHECK(flagpp::flags::is_enabled_for("rollout_half", "user-1") ==
+          flag.is_enabled(std::string_view("user-1")));
+  }
+
+  SUBCASE("Evaluation is stable and seed dependent") {
+    flagpp::Rollout a = flagpp::Rollout::percentage(50.0, 1);
+    flagpp::Rollout b = flagpp::Rollout::percentage(50.0, 2);
+    CHECK(a.bucket("tenant-42") == a.bucket("tenant-42"));
+    int differs = 0;
+    for (std::uint64_t id = 0; id < 1000; ++id) {
+      CHECK(a.bucket(id) < flagpp::Rollout::buckets);
+      differs += a.bucket(id) != b.bucket(id);
+    }
+    CHECK(differs > 900);
+  }
+
+  SUBCASE("Variants and the fallback value") {
+    flagpp::Rollout rollout({{flagpp::FlagValue(std::string("A")), 30000},
+                             {flagpp::FlagValue(std::string("B")), 30000}});
+    auto flag = flagpp::flags::define_rollout("rollout_variants",
+                                              std::string("control"), rollout);
+    int a = 0, b = 0, control = 0;
+    for (std::uint64_t id = 0; id < 10000; ++id) {
+      std::string v = static_cast<std::string>(flag.evaluate(id));
+      a += v == "A";
+      b += v == "B";
+      control += v == "control";
+      CHECK(v == static_cast<std::string>(
+                     rollout.variant(id) == flagpp::Rollout::npos
+                         ? flagpp::Value(std::string("control"))
+                         : flagpp::Value(rollout.value(rollout.variant(id)))));
+    }
+    CHECK(a + b + control == 10000);
+    CHECK(control > 3500);
+    CHECK(a > 2500);
+    CHECK(b > 2500);
+
+    flag->clear_rollout();
+    CHECK(static_cast<std::string>(flag.evaluate("anyone")) == "control");
+  }
+
+  SUBCASE("Edge percentages") {
+    flagpp::Flag flag("rollout_edges", false);
+    flag.set_rollout(flagpp::Rollout::percentage(0.0));
+    CHECK_FALSE(flag.is_enabled_for("user"));
+    flag.set_rollout(flagpp::Rollout::percentage(100.0));
+    CHECK(flag.is_enabled_for("user"));
+  }
+}
+
+TEST_CASE("Batch evaluation") {
+  flagpp::flags::define("batch_bool", true);
+  flagpp::flags::define("batch_int", 3);
+  flagpp::flags::define("batch_string", "s");
+  auto rollout = flagpp::flags::define_rollout(
+      "batch_rollout", false, flagpp::Rollout::percentage(100.0));
+
+  flagpp::EvaluationContext context{"user-1"};
+
+  SUBCASE("By name") {
+    std::string_view names[] = {"batch_bool", "batch_missing", "batch_int",
+                                "batch_string", "batch_rollout"};
+    flagpp::FlagValue results[5];
+    CHECK(flagpp::flags::evaluate(names, 5, context, results) == 4);
+    CHECK(std::get<bool>(results[0]) == true);
+    CHECK(std::get<bool>(results[1]) == false);
+    CHECK(std::get<int>(results[2]) == 3);
+    CHECK(std::get<std::string>(results[3]) == "s");
+    CHECK(std::get<bool>(results[4]) == true);
+  }
+
+  SUBCASE("By name in a sharded and a frozen registry") {
+    flagpp::FlagRegistry registry(flagpp::RegistryOptions{8});
+    std::vector<std::string> owned;
+    for (int i = 0; i < 50; ++i) {
+      owned.push_back("batch_" + std::to_string(i));
+      registry.define(owned.back(), i);
+    }
+    std::vector<std::string_view> names(owned.begin(), owned.end());
+    std::vector<flagpp::FlagValue> results(names.size());
+
+    for (bool frozen : {false, true}) {
+      if (frozen) {
+        registry.freeze();
+      }
+      CHECK(registry.evaluate(names.data(), names.size(), context,
+                              results.data()) == 50);
+      for (int i = 0; i < 50; ++i) {
+        CHECK(std::get<int>(results[i]) == i);
+      }
+    }
+  }
+
+  SUBCASE("By handle") {
+    std::shared_ptr<flagpp::Flag> handles[] = {
+        flagpp::flags::get("batch_int"), rollout.flag()};
+    flagpp::FlagValue results[2];
+    flagpp::evaluate(handles, 2, context, results);
+    CHECK(std::get<int>(results[0]) == 3);
+    CHECK(std::get<bool>(results[1]) == true);
+  }
+}
+
+TEST_CASE("Bulk evaluation matches single-key evaluation") {
+  std::vector<std::uint64_t> ids;
+  std::uint64_t x = 88172645463325252ULL;
+  for (int i = 0; i < 1000; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    ids.push_back(i % 10 == 0 ? static_cast<std::uint64_t>(i) : x);
+  }
+
+  flagpp::Flag percentage("bulk_percentage", false);
+  percentage.set_rollout(flagpp::Rollout::percentage(37.5, 11));
+
+  flagpp::Flag variants("bulk_variants", true);
+  variants.set_rollout(flagpp::Rollout({{flagpp::FlagValue(false), 20000},
+                                        {flagpp::FlagValue(true), 30000},
+                                        {flagpp::FlagValue(std::string("x")), 10000}},
+                                       5));
+
+  flagpp::Flag plain("bulk_plain", true);
+
+  for (const flagpp::Flag* flag : {&percentage, &variants, &plain}) {
+    for (auto level : {flagpp::SimdLevel::scalar, flagpp::SimdLevel::sse42,
+                       flagpp::SimdLevel::avx2}) {
+      if (!flagpp::simd_supported(level)) {
+        continue;
+      }
+      CAPTURE(static_cast<int>(level));
+      std::vector<std::uint64_t> bitmap((ids.size() + 63) / 64, ~0ULL);
+      flagpp::bulk_is_enabled(*flag, ids.data(), ids.size(), bitmap.data(),
+                              level);
+
+      int mismatches = 0;
+      for (std::size_t i = 0; i < ids.size(); ++i) {
+        bool bit = (bitmap[i / 64] >> (i % 64)) & 1;
+        mismatches += bit != flag->is_enabled_for(ids[i]);
+      }
+      CHECK(mismatches == 0);
+      CHECK((bitmap.back() >> (ids.size() % 64)) == 0);
+    }
+  }
+
+  SUBCASE("Bulk evaluations are counted and exposed like single ones") {
+    struct Recorder final : flagpp::detail::ExposureSink {
+      std::vector<std::pair<std::uint64_t, std::size_t>> seen;
+      void record(const flagpp::Flag&, std::string_view, flagpp::ExposureSource,
+                  std::size_t) noexcept override {}
+      void record(const flagpp::Flag&, std::uint64_t key, flagpp::ExposureSource,
+                  std::size_t index) noexcept override {
+        seen.emplace_back(key, index);
+      }
+    } recorder;
+    REQUIRE(variants.enable_counting());
+    variants.set_exposure_sink(&recorder);
+    std::vector<std::uint64_t> bitmap((ids.size() + 63) / 64);
+    flagpp::bulk_is_enabled(variants, ids.data(), ids.size(), bitmap.data());
+    variants.set_exposure_sink(nullptr);
+
+    CHECK(variants.evaluation_count() == ids.size());
+    REQUIRE(recorder.seen.size() == ids.size());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      CHECK(recorder.seen[i].first == ids[i]);
+      CHECK(recorder.seen[i].second == variants.rollout_in_guard()->variant(ids[i]));
+    }
+  }
+}
+
+TEST_CASE("Targeting rules") {
+  using Op = flagpp::Condition::Op;
+  auto flag = flagpp::flags::define("rules_checkout", std::string("A"));
+  REQUIRE(flagpp::flags::set_rules(
+      "rules_checkout",
+      {{{{"country", Op::in, {"US", "CA"}},
+         {"app_version", Op::greater_equal, {flagpp::version("5.2")}}},
+        flagpp::FlagValue(std::string("B"))},
+       {{{"beta", Op::equals, {true}}}, flagpp::FlagValue(std::string("C"))}}));
+  CHECK(flag->has_rules());
+
+  SUBCASE("First matching rule wins") {
+    flagpp::Attribute attributes[] = {{"country", "CA"},
+                                      {"app_version", flagpp::version("5.10.1")},
+                                      {"beta", true}};
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u1", attributes))) == "B");
+  }
+
+  SUBCASE("Later rules and the default") {
+    flagpp::Attribute old_app[] = {{"country", "US"},
+                                   {"app_version", flagpp::version("5.1.9")},
+                                   {"beta", true}};
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u2", old_app))) == "C");
+
+    flagpp::Attribute elsewhere[] = {{"country", "FR"},
+                                     {"app_version", flagpp::version("6")}};
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u3", elsewhere))) == "A");
+
+    // Without a context, rules are not consulted
+    CHECK(static_cast<std::string>(flag->evaluate(std::string_view("u1"))) == "A");
+  }
+
+  SUBCASE("Missing attributes and mismatched kinds never match") {
+    flagpp::Rule rule{{{"plan", Op::not_in, {"free"}}}, flagpp::FlagValue(true)};
+    flagpp::RuleSet rules({rule});
+
+    flagpp::Attribute paid[] = {{"plan", "pro"}};
+    flagpp::Attribute free_plan[] = {{"plan", "free"}};
+    flagpp::Attribute numeric[] = {{"plan", 3}};
+    CHECK(rules.match(flagpp::EvaluationContext("k", paid)) == 0);
+    CHECK(rules.match(flagpp::EvaluationContext("k", free_plan)) == flagpp::RuleSet::npos);
+    CHECK(rules.match(flagpp::EvaluationContext("k")) == flagpp::RuleSet::npos);
+    CHECK(rules.match(flagpp::EvaluationContext("k", numeric)) == 0);
+  }
+
+  SUBCASE("Rules take precedence over the rollout") {
+    flag->set_rollout(flagpp::Rollout({{flagpp::FlagValue(std::string("R")), 100000}}));
+    flagpp::Attribute beta[] = {{"beta", 1}};
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u4", beta))) == "C");
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u4"))) == "R");
+    flag->clear_rollout();
+    flag->clear_rules();
+    CHECK_FALSE(flag->has_rules());
+    CHECK(static_cast<std::string>(
+              flag->evaluate(flagpp::EvaluationContext("u4", beta))) == "A");
+  }
+}
+
+TEST_CASE("Binary snapshots") {
+  const std::string path = "flagpp_test.snapshot";
+  {
+    flagpp::FlagRegistry source;
+    source.define("snap_bool", true, "A boolean");
+    source.define("snap_int", -42);
+    source.define("snap_double", 2.5, "A double");
+    source.define("snap_string", std::string("hello"), "A string");
+    REQUIRE(flagpp::save_snapshot(source, path));
+  }
+
+  std::shared_ptr<flagpp::Flag> kept;
+  {
+    flagpp::FlagRegistry loaded;
+    auto existing = loaded.define("snap_int", 7);
+    REQUIRE(flagpp::load_snapshot(loaded, path));
+    CHECK(loaded.get_all().size() == 4);
+
+    CHECK(static_cast<bool>(loaded.get("snap_bool")->value()) == true);
+    CHECK(loaded.get("snap_bool")->description() == "A boolean");
+    CHECK(existing.load() == -42); // Existing flags take the snapshot value
+    CHECK(static_cast<double>(loaded.get("snap_double")->value()) == 2.5);
+    kept = loaded.get("snap_string");
+    CHECK(static_cast<std::string>(kept->value()) == "hello");
+
+    kept->update(std::string("changed"));
+    CHECK(static_cast<std::string>(loaded.get("snap_string")->value()) == "changed");
+  }
+  // The mapping outlives the registry while a loaded flag is held
+  CHECK(kept->name() == "snap_string");
+  CHECK(kept->description() == "A string");
+
+  SUBCASE("Flags are constructed on first lookup") {
+    flagpp::FlagRegistry loaded;
+    REQUIRE(flagpp::load_snapshot(loaded, path));
+    CHECK(loaded.exists("snap_bool"));
+    CHECK_FALSE(loaded.exists("snap_missing"));
+    CHECK(loaded.define("snap_int", 0).load() == -42); // The snapshot's flag
+    CHECK_FALSE(loaded.insert(std::make_shared<flagpp::Flag>("snap_double", 1.0)));
+
+    std::string_view names[] = {"snap_string", "snap_missing"};
+    flagpp::FlagValue results[2];
+    CHECK(loaded.evaluate(names, 2, flagpp::EvaluationContext("u1"), results) == 1);
+    CHECK(std::get<std::string>(results[0]) == "hello");
+
+    REQUIRE(loaded.freeze());
+    CHECK(loaded.get_all().size() == 4);
+    CHECK(static_cast<bool>(loaded.get("snap_bool")->value()) == true);
+  }
+
+  SUBCASE("Corrupt files are rejected") {
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    REQUIRE(file != nullptr);
+    std::fseek(file, -1, SEEK_END);
+    std::fputc('!', file);
+    std::fclose(file);
+
+    flagpp::FlagRegistry loaded;
+    CHECK_FALSE(flagpp::load_snapshot(loaded, path));
+    CHECK(loaded.get_all().empty());
+    CHECK_FALSE(flagpp::load_snapshot(loaded, path + ".missing"));
+  }
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Hot reload from a watched file") {
+  flagpp::FlagRegistry registry;
+  auto enabled = registry.define("reload_enabled", false);
+  auto timeout = registry.define("reload_timeout", 30);
+  auto ratio = registry.define("reload_ratio", 0.5);
+  auto endpoint = registry.define("reload_endpoint", std::string("a"));
+
+  SUBCASE("Parsing and applying") {
+    std::size_t changed = 0;
+    CHECK(flagpp::apply_config(registry,
+                               "# comment\n"
+                               "reload_enabled = true\n"
+                               "\n"
+                               "reload_timeout = 30\n"
+                               "reload_ratio=2\n"
+                               "reload_endpoint = \"https://x = y\"\n"
+                               "unknown_flag = 1\n",
+                               &changed));
+    CHECK(changed == 3); // reload_timeout was already 30
+    CHECK(enabled.load() == true);
+    CHECK(ratio.load() == 2.0);
+    CHECK(static_cast<std::string>(endpoint->value()) == "https://x = y");
+
+    // A malformed line rejects the whole file
+    CHECK_FALSE(flagpp::apply_config(registry, "reload_enabled = false\nreload_timeout = soon\n"));
+    CHECK(enabled.load() == true);
+    CHECK_FALSE(flagpp::apply_config(registry, "no assignment here\n"));
+  }
+
+#if defined(__linux__)
+  SUBCASE("Atomic renames are picked up") {
+    const std::string path = "flagpp_reload_test.conf";
+    auto write = [&](const std::string& contents) {
+      std::FILE* file = std::fopen((path + ".tmp").c_str(), "w");
+      REQUIRE(file != nullptr);
+      std::fputs(contents.c_str(), file);
+      std::fclose(file);
+      REQUIRE(std::rename((path + ".tmp").c_str(), path.c_str()) == 0);
+    };
+
+    write("reload_timeout = 45\n");
+    flagpp::FileWatcher watcher(registry, path);
+    REQUIRE(watcher.start());
+    CHECK(timeout.load() == 45); // Loaded on start
+
+    write("reload_timeout = 60\nreload_enabled = true\n");
+    CHECK(wait_for([&] { return timeout.load() == 60 && enabled.load(); }));
+
+    write("reload_timeout = broken\n");
+    CHECK(wait_for([&] { return watcher.failures() == 1; }));
+    CHECK(timeout.load() == 60);
+
+    watcher.stop();
+    std::remove(path.c_str());
+  }
+#endif
+}
+
+TEST_CASE("Transactions and consistent snapshots") {
+  flagpp::FlagRegistry registry;
+  auto endpoint = registry.define("tx_endpoint", std::string("https://v0"));
+  auto timeout = registry.define("tx_timeout", 0);
+
+  SUBCASE("Snapshots keep the version they pinned") {
+    auto before = registry.snapshot();
+    auto transaction = registry.transaction();
+    CHECK(transaction.set("tx_endpoint", std::string("https://v1")));
+    CHECK(transaction.set("tx_timeout", 1));
+    CHECK_FALSE(transaction.set("tx_missing", 1));
+    CHECK(endpoint.load() == "https://v0"); // Nothing visible before commit
+    transaction.commit();
+    CHECK(transaction.size() == 0);
+
+    auto after = registry.snapshot();
+    CHECK(after.version() > before.version());
+    endpoint.update("https://v2");
+    timeout.update(2);
+
+    CHECK(before.get_value<std::string>("tx_endpoint") == std::string("https://v0"));
+    CHECK(before.get_value<int>("tx_timeout") == 0);
+    CHECK(after.get_value<std::string>("tx_endpoint") == std::string("https://v1"));
+    CHECK(static_cast<int>(after.value(*timeout)) == 1);
+    CHECK(registry.snapshot().get_value<int>("tx_timeout") == 2);
+    CHECK_FALSE(after.get_value<int>("tx_endpoint").has_value());
+    CHECK_FALSE(after.is_enabled("tx_missing"));
+  }
+
+  SUBCASE("Readers never observe a torn pair") {
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+      readers.emplace_back([&] {
+        while (!done.load(std::memory_order_relaxed)) {
+          auto view = registry.snapshot();
+          std::string url = static_cast<std::string>(view.value(*endpoint));
+          int seconds = static_cast<int>(view.value(*timeout));
+          torn += url != "https://v" + std::to_string(seconds);
+        }
+      });
+    }
+    for (int i = 1; i <= 2000; ++i) {
+      auto transaction = registry.transaction();
+      transaction.set(endpoint.flag(), "https://v" + std::to_string(i));
+      transaction.set(timeout.flag(), i);
+      transaction.commit();
+    }
+    done = true;
+    for (auto& reader : readers) {
+      reader.join();
+    }
+    CHECK(torn.load() == 0);
+    CHECK(timeout.load() == 2000);
+  }
+
+  SUBCASE("Single-flag writes stay repeatable within a snapshot") {
+    std::atomic<bool> done{false};
+    std::atomic<int> changed{0};
+    std::thread reader([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        auto view = registry.snapshot();
+        int first = static_cast<int>(view.value(*timeout));
+        std::this_thread::yield();
+        changed += static_cast<int>(view.value(*timeout)) != first;
+      }
+    });
+    for (int i = 1; i <= 2000; ++i) {
+      if (i % 4 == 0) {
+        auto transaction = registry.transaction();
+        transaction.set(endpoint.flag(), "https://v" + std::to_string(i));
+        transaction.set(timeout.flag(), i);
+        transaction.commit();
+      } else {
+        timeout.update(i); // Skips the commit mutex unless a snapshot is pinned
+      }
+    }
+    done = true;
+    reader.join();
+    CHECK(changed.load() == 0);
+    CHECK(timeout.load() == 2000);
+    CHECK(registry.snapshot().get_value<int>("tx_timeout") == 2000);
+  }
+}
+
+TEST_CASE("Change subscriptions") {
+  auto flag = flagpp::flags::define("subscribed_limit", 0);
+
+  std::atomic<int> calls{0};
+  std::atomic<int> last{-1};
+  std::atomic<bool> entered{false};
+  std::atomic<bool> release{false};
+  auto subscription = flagpp::flags::subscribe(
+      "subscribed_limit", [&](const flagpp::Flag& changed, const flagpp::Value& value) {
+        CHECK(changed.name() == "subscribed_limit");
+        entered = true;
+        while (!release.load()) {
+          std::this_thread::yield();
+        }
+        last = static_cast<int>(value);
+        ++calls;
+      });
+  REQUIRE(subscription);
+  CHECK_FALSE(flagpp::flags::subscribe("subscribed_missing", [](auto&, auto&) {}));
+
+  // The first update occupies the notifier; the storm behind it coalesces
+  flag.update(1);
+  REQUIRE(wait_for([&] { return entered.load(); }));
+  for (int i = 2; i <= 1000; ++i) {
+    flag.update(i);
+  }
+  release = true;
+  CHECK(wait_for([&] { return last.load() == 1000; }));
+  CHECK(calls.load() == 2);
+
+  // After reset the callback is gone; a second subscriber proves a
+  // dispatch happened
+  subscription.reset();
+  std::atomic<bool> sentinel{false};
+  auto other = flag->subscribe([&](auto&, auto&) { sentinel = true; });
+  flag.update(5);
+  CHECK(wait_for([&] { return sentinel.load(); }));
+  CHECK(calls.load() == 2);
+}
+
+TEST_CASE("Blocking wait for a change") {
+  auto kill_switch = flagpp::flags::define("wait_kill_switch", false);
+  std::uint32_t version = kill_switch->change_version();
+
+  CHECK_FALSE(kill_switch->wait_for_change(version, std::chrono::milliseconds(5)));
+
+  std::atomic<bool> woke{false};
+  std::thread waiter([&] {
+    woke = kill_switch->wait_for_change(version, std::chrono::seconds(10));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  kill_switch.update(true);
+  waiter.join();
+  CHECK(woke.load());
+  CHECK(kill_switch->change_version() == version + 1);
+
+  // An already-stale version returns at once
+  CHECK(kill_switch->wait_for_change(version, std::chrono::seconds(10)));
+}
+
+TEST_CASE("Per-thread evaluation counters") {
+  flagpp::FlagRegistry registry(flagpp::RegistryOptions{1, true});
+  auto hot = registry.define("count_hot", true);
+  auto cold = registry.define("count_cold", 3);
+  CHECK(hot->is_counting());
+  CHECK(hot->evaluation_count() == 0);
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        (void)hot.load();
+      }
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  (void)hot->value();
+  flagpp::FlagCache cache(registry);
+  (void)cache.is_enabled("count_hot");
+  CHECK(hot->evaluation_count() == 4002);
+
+  auto counts = registry.evaluation_counts();
+  REQUIRE(counts.size() == 2);
+  for (const auto& [flag, count] : counts) {
+    CHECK(count == (flag->name() == "count_hot" ? 4002u : 0u));
+  }
+
+  // Flags outside a counting registry cost nothing and report nothing
+  flagpp::Flag plain("count_plain", false);
+  (void)plain.value();
+  CHECK_FALSE(plain.is_counting());
+  CHECK(plain.evaluation_count() == 0);
+  CHECK(plain.enable_counting());
+  (void)plain.value();
+  CHECK(plain.evaluation_count() == 1);
+  (void)cold;
+}
+
+TEST_CASE("Exposure logging") {
+  flagpp::FlagRegistry registry;
+  auto checkout = registry.define_rollout(
+      "exposure_checkout", std::string("control"),
+      flagpp::Rollout({{flagpp::FlagValue(std::string("new")), 50000}}, 3));
+  auto untracked = registry.define("exposure_untracked", true);
+
+  std::mutex mutex;
+  std::vector<std::string> lines;
+  flagpp::ExposureOptions options;
+  options.flush_interval = std::chrono::hours(1); // Flushed by hand below
+  flagpp::ExposureLog log(
+      [&](const flagpp::Exposure* events, std::size_t count) {
+        std::lock_guard lock(mutex);
+        for (std::size_t i = 0; i < count; ++i) {
+          const auto& e = events[i];
+          lines.push_back(std::string(e.flag->name()) + " " + std::string(e.key()) +
+                          " " + std::to_string(static_cast<int>(e.source)) + " " +
+                          std::to_string(e.index));
+        }
+      },
+      options);
+  CHECK(log.track(registry, "exposure_checkout"));
+  CHECK_FALSE(log.track(registry, "exposure_missing"));
+
+  std::thread other([&] {
+    (void)checkout.evaluate(std::uint64_t{12345});
+  });
+  other.join();
+  for (int i = 0; i < 3; ++i) {
+    (void)checkout.evaluate(std::string_view("user-1"));
+  }
+  (void)untracked->is_enabled_for(std::string_view("user-1"));
+  (void)checkout->value(); // Unkeyed reads are not exposures
+  log.flush();
+
+  REQUIRE(lines.size() == 2);
+  std::sort(lines.begin(), lines.end());
+  std::size_t user1 = checkout->rollout_in_guard()->variant(std::string_view("user-1"));
+  std::size_t numeric = checkout->rollout_in_guard()->variant(std::uint64_t{12345});
+  auto expected = [](const char* key, std::size_t index) {
+    return index == flagpp::Rollout::npos
+               ? "exposure_checkout " + std::string(key) + " 0 4294967295"
+               : "exposure_checkout " + std::string(key) + " 1 " + std::to_string(index);
+  };
+  CHECK(lines[0] == expected("12345", numeric));
+  CHECK(lines[1] == expected("user-1", user1));
+  CHECK(log.delivered() == 2);
+  CHECK(log.duplicates() == 2);
+  CHECK(log.dropped() == 0);
+
+  SUBCASE("Sampling is per key and full buffers drop") {
+    flagpp::ExposureOptions sampled;
+    sampled.sample_rate = 0.5;
+    sampled.ring_capacity = 8;
+    sampled.flush_interval = std::chrono::hours(1);
+    auto flag = registry.define("exposure_sampled", false);
+    std::size_t seen = 0;
+    {
+      flagpp::ExposureLog small(
+          [&](const flagpp::Exposure*, std::size_t count) { seen += count; }, sampled);
+      CHECK(small.track(registry, "exposure_sampled"));
+      CHECK_FALSE(small.track(registry, "exposure_checkout"));
+      std::size_t kept = 0;
+      for (std::uint64_t key = 0; key < 1000; ++key) {
+        (void)flag->is_enabled_for(key);
+        kept += flagpp::detail::hash_u64(key, 0) < (std::uint64_t{1} << 63);
+      }
+      CHECK(kept > 400);
+      CHECK(kept < 600);
+      small.flush();
+      CHECK(seen == 8);
+      CHECK(small.dropped() == kept - 8);
+    }
+    CHECK(flag->exposure_sink() == nullptr);
+  }
+
+  SUBCASE("Out-of-range sample rates are clamped") {
+    auto flag = registry.define("exposure_clamped", false);
+    for (double rate : {std::numeric_limits<double>::quiet_NaN(), -1.0, 2.0}) {
+      flagpp::ExposureOptions clamped;
+      clamped.sample_rate = rate;
+      clamped.flush_interval = std::chrono::hours(1);
+      std::size_t seen = 0;
+      flagpp::ExposureLog edge(
+          [&](const flagpp::Exposure*, std::size_t count) { seen += count; }, clamped);
+      CHECK(edge.track(registry, "exposure_clamped"));
+      for (std::uint64_t key = 0; key < 100; ++key) {
+        (void)flag->is_enabled_for(key);
+      }
+      edge.flush();
+      CHECK(seen == (rate > 1.0 ? 100u : 0u)); // NaN samples nothing
+    }
+  }
+
+  SUBCASE("Logs racing to track one flag attach exactly one") {
+    auto flag = registry.define("exposure_contended", false);
+    for (int round = 0; round < 50; ++round) {
+      flagpp::ExposureOptions quiet;
+      quiet.flush_interval = std::chrono::hours(1);
+      auto ignore = [](const flagpp::Exposure*, std::size_t) {};
+      flagpp::ExposureLog first(ignore, quiet);
+      flagpp::ExposureLog second(ignore, quiet);
+      std::atomic<int> attached{0};
+      std::thread racer([&] { attached += second.track(flag.flag()); });
+      attached += first.track(flag.flag());
+      racer.join();
+      CHECK(attached == 1);
+      CHECK(flag->exposure_sink() != nullptr);
+    }
+    CHECK(flag->exposure_sink() == nullptr);
+  }
+
+  SUBCASE("File sink writes JSON lines") {
+    const char* path = "exposures.jsonl";
+    std::remove(path);
+    auto sink = flagpp::exposure_file_sink(path);
+    REQUIRE(sink);
+    flagpp::Exposure event{};
+    event.flag = checkout.operator->();
+    event.index = UINT32_MAX;
+    event.source = flagpp::ExposureSource::value;
+    event.key_size = 4;
+    std::memcpy(event.key_data, "a\"b\n", 4);
+    sink(&event, 1);
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    CHECK(line == "{\"time_ns\":0,\"flag\":\"exposure_checkout\",\"key\":\"a\\\"b\\u000a\","
+                  "\"source\":\"value\",\"index\":-1}");
+    std::remove(path);
+  }
+}
+
+#if defined(__linux__)
+TEST_CASE("Shared-memory flag table") {
+  const std::string name = "/flagpp-test-" + std::to_string(::getpid());
+  flagpp::SharedFlagWriter::remove(name);
+  flagpp::SharedFlagWriter writer;
+  REQUIRE(writer.create(name, 60));
+  flagpp::SharedFlagReader reader;
+  REQUIRE(reader.open(name));
+
+  CHECK(writer.publish("shm_enabled", flagpp::FlagValue(true)));
+  CHECK(writer.publish("shm_limit", flagpp::FlagValue(42)));
+  CHECK(writer.publish("shm_ratio", flagpp::FlagValue(0.25)));
+  CHECK(writer.publish("shm_mode", flagpp::FlagValue(std::string("fast"))));
+  CHECK_FALSE(writer.publish(std::string(49, 'n'), flagpp::FlagValue(true)));
+  CHECK_FALSE(writer.publish("shm_long", flagpp::FlagValue(std::string(65, 's'))));
+
+  CHECK(reader.is_enabled("shm_enabled"));
+  CHECK(reader.get_value<int>("shm_limit") == 42);
+  CHECK(reader.get_value<double>("shm_ratio") == 0.25);
+  CHECK(reader.get_value<std::string>("shm_mode") == "fast");
+  CHECK_FALSE(reader.get_value<int>("shm_mode"));
+  CHECK_FALSE(reader.get("shm_missing"));
+
+  std::size_t limit = reader.find("shm_limit");
+  REQUIRE(limit != flagpp::SharedFlagReader::npos);
+  CHECK(writer.publish("shm_limit", flagpp::FlagValue(-7)));
+  CHECK(reader.scalar<int>(limit) == -7);
+  CHECK(reader.scalar<bool>(limit) == false);
+
+  // Another process sees the same values through its own mapping
+  pid_t child = ::fork();
+  REQUIRE(child >= 0);
+  if (child == 0) {
+    flagpp::SharedFlagReader other;
+    bool ok = other.open(name) && other.is_enabled("shm_enabled") &&
+              other.get_value<int>("shm_limit") == -7 &&
+              other.get_value<std::string>("shm_mode") == "fast";
+    ::_exit(ok ? 0 : 1);
+  }
+  int status = 0;
+  REQUIRE(::waitpid(child, &status, 0) == child);
+  CHECK(WIFEXITED(status));
+  CHECK(WEXITSTATUS(status) == 0);
+
+  SUBCASE("Registries publish and apply in batches") {
+    flagpp::FlagRegistry source;
+    source.define("shm_enabled", false);
+    source.define("shm_limit", 100);
+    source.define("shm_region", std::string("eu"));
+    CHECK(writer.publish(source) == 3);
+
+    flagpp::FlagRegistry local;
+    local.define("shm_limit", 1);
+    CHECK(reader.apply_to(local) == 5); // Four added, one changed
+    auto view = local.snapshot();
+    CHECK(view.get_value<int>("shm_limit") == 100);
+    CHECK(view.get_value<std::string>("shm_region") == "eu");
+    CHECK(view.get_value<bool>("shm_enabled") == false);
+    CHECK(view.get_value<double>("shm_ratio") == 0.25);
+    CHECK(reader.apply_to(local) == 0);
+  }
+
+  SUBCASE("Reopening keeps values and checks the layout") {
+    flagpp::SharedFlagWriter again;
+    CHECK_FALSE(again.create(name, 128));
+    REQUIRE(again.create(name, 64));
+    CHECK(reader.get_value<int>("shm_limit") == -7);
+  }
+
+  SUBCASE("Damaged slots and writes left open fail reads until reopened") {
+    namespace shm = flagpp::detail::shm;
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    REQUIRE(fd >= 0);
+    void* data = ::mmap(nullptr, shm::table_size(64), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    ::close(fd);
+    REQUIRE(data != MAP_FAILED);
+    auto* header = static_cast<shm::Header*>(data);
+    auto* slots = reinterpret_cast<shm::Slot*>(static_cast<char*>(data) + sizeof(shm::Header));
+    shm::Slot& slot = slots[limit];
+
+    // A name size beyond the slot is clamped rather than copied past it
+    std::uint32_t meta = slot.meta.load();
+    slot.meta.store(meta | 0xff00);
+    CHECK_FALSE(reader.get("shm_limit"));
+    slot.meta.store(meta);
+
+    // As if the writer died mid-write
+    slot.sequence.fetch_add(1);
+    header->sequence.fetch_add(1);
+    CHECK(reader.find("shm_limit") == flagpp::SharedFlagReader::npos);
+    CHECK_FALSE(reader.value(limit));
+    CHECK(reader.scalar<int>(limit) == 0);
+    flagpp::FlagRegistry local;
+    CHECK(reader.apply_to(local) == 0);
+
+    flagpp::SharedFlagWriter again;
+    REQUIRE(again.create(name, 64));
+    CHECK(reader.get_value<int>("shm_limit") == -7);
+    CHECK(reader.apply_to(local) == 4);
+
+    // A header whose capacity is not a power of two is rejected, even
+    // when the object's size matches it
+    const std::string forged = name + "-forged";
+    for (std::uint32_t capacity : {0u, 3u}) {
+      fd = ::shm_open(forged.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+      REQUIRE(fd >= 0);
+      REQUIRE(::ftruncate(fd, static_cast<off_t>(shm::table_size(capacity))) == 0);
+      void* copy = ::mmap(nullptr, sizeof(shm::Header), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+      ::close(fd);
+      REQUIRE(copy != MAP_FAILED);
+      std::memcpy(copy, data, sizeof(shm::Header));
+      static_cast<shm::Header*>(copy)->capacity = capacity;
+      ::munmap(copy, sizeof(shm::Header));
+      flagpp::SharedFlagReader bad;
+      CHECK_FALSE(bad.open(forged));
+      CHECK(flagpp::SharedFlagWriter::remove(forged));
+    }
+    ::munmap(data, shm::table_size(64));
+  }
+
+  CHECK(flagpp::SharedFlagWriter::remove(name));
+  flagpp::SharedFlagReader gone;
+  CHECK_FALSE(gone.open(name));
+}
+#endif
+
+TEST_CASE("Scalar reads are consistent under concurrent updates") {
+  flagpp::FlagRegistry registry;
+  auto flag = registry.define("seqlock_scalar", -1);
+  std::atomic<bool> stop{false};
+  std::atomic<int> torn{0};
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        flagpp::Value value = flag->value();
+        bool whole = value.get<int>() == -1 || value.get<double>() == 0.5 ||
+                     value.get<std::string>() == "text";
+        int i = flag->scalar<int>();
+        double d = flag->scalar<double>();
+        torn += !whole + (i != -1 && i != 0) + (d != 0.5 && d != 0.0);
+      }
+    });
+  }
+  for (int i = 0; i < 20000; ++i) {
+    if (i % 3 == 0) {
+      flag->update(-1);
+    } else if (i % 3 == 1) {
+      flag->update(0.5);
+    } else {
+      flag->update(std::string("text"));
+    }
+  }
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  CHECK(torn == 0);
+
+  flag->update(0.5);
+  CHECK(static_cast<double>(flag->value()) == 0.5);
+  CHECK(flag->scalar<bool>() == false);
+  flag->update(std::string("text"));
+  CHECK(static_cast<std::string>(flag->value()) == "text");
+  CHECK(flag->scalar<double>() == 0.0);
+}
+
+TEST_CASE("Hot values are kept apart from flags") {
+  flagpp::FlagRegistry registry;
+  std::vector<flagpp::TypedFlag<int>> handles;
+  for (int i = 0; i < 3000; ++i) {
+    handles.push_back(registry.define("hot_" + std::to_string(i), i));
+  }
+  for (int i = 0; i < 3000; i += 7) {
+    handles[i].update(-i);
+  }
+  for (int i = 0; i < 3000; ++i) {
+    CHECK(handles[i].load() == (i % 7 == 0 ? -i : i));
+  }
+
+  // A destroyed flag's slot is reused without its counter
+  auto counted = std::make_shared<flagpp::Flag>("hot_counted", 1.5);
+  REQUIRE(counted->enable_counting());
+  (void)counted->scalar<double>();
+  CHECK(counted->evaluation_count() == 1);
+  counted.reset();
+  auto reused = std::make_shared<flagpp::Flag>("hot_reused", true);
+  CHECK_FALSE(reused->is_counting());
+  CHECK(flagpp::TypedFlag<bool>(reused).load());
+  CHECK(flagpp::TypedFlag<double>(reused).load() == 0.0);
+}
+
+TEST_CASE("Registry arena") {
+  flagpp::RegistryOptions options;
+  options.shards = 4;
+  options.arena = true;
+  flagpp::TypedFlag<std::string> survivor;
+  {
+    flagpp::FlagRegistry registry(options);
+    for (int i = 0; i < 500; ++i) {
+      registry.define("arena_" + std::to_string(i), i, "Flag number " + std::to_string(i));
+    }
+    auto flag = registry.get("arena_123");
+    REQUIRE(flag != nullptr);
+    CHECK(flag->name() == "arena_123");
+    CHECK(flag->description() == "Flag number 123");
+    CHECK(registry.handle<int>("arena_499").load() == 499);
+    CHECK(registry.define("arena_7", 0).load() == 7); // Existing flags are returned
+    CHECK(registry.update("arena_7", 70));
+    CHECK(registry.handle<int>("arena_7").load() == 70);
+    CHECK(registry.insert(std::make_shared<flagpp::Flag>("arena_inserted", true)));
+    CHECK(registry.get_all().size() == 501);
+    survivor = registry.define("arena_survivor", std::string("still here"), "");
+  }
+  // The handle keeps the arena, and so the flag and its name, alive
+  CHECK(survivor->name() == "arena_survivor");
+  CHECK(survivor.load() == "still here");
+  survivor.update("updated");
+  CHECK(survivor.load() == "updated");
+}
@@ -0,0 +1,10 @@
+// A second translation unit for the static flag tests: it defines a flag
+// the main test file declares, and reads one the main file defines.
+#include "flagpp.hpp"
+
+#include <string>
+
+FLAGPP_DEFINE_INT(static_retries, 3, "Defined in another unit");
+FLAGPP_DECLARE_STRING(static_endpoint);
+
+std::string static_endpoint_from_other_unit() { return FLAGPP_static_endpoint.load(); }